@@ -50,6 +50,9 @@ public class MDAEditor : ModuleRules
 				"UnrealEd",
 				"BlueprintGraph",
 				"GraphEditor",
+				"AssetTools",
+				"AssetRegistry",
+				"Json",
 
 			}
 			);
@@ -3,9 +3,18 @@
 #include "AnimGraphNode_MDA.h"
 #include "MDACommands.h"
 #include "MDAEditor.h"
+#include "MDARuntime.h"
+#include "MDALayerBaker.h"
 #include "ScopedTransaction.h"
 #include "ToolMenus.h"
+#include "K2Node_Knot.h"
+#include "AnimGraphNode_SequencePlayer.h"
+#include "AnimationGraphSchema.h"
 #include "Kismet2/BlueprintEditorUtils.h"
+#include "Animation/AnimBlueprint.h"
+#include "Animation/AnimSequence.h"
+#include "EdGraph/EdGraph.h"
+#include "Misc/MessageDialog.h"
 
 #ifdef UE_INLINE_GENERATED_CPP_BY_NAME
 #include UE_INLINE_GENERATED_CPP_BY_NAME(AnimGraphNode_MDA)
@@ -17,7 +26,7 @@
 #define LOCTEXT_NAMESPACE "AnimGraphNode_MDA"
 
 UAnimGraphNode_MDA::UAnimGraphNode_MDA(const FObjectInitializer& ObjectInitializer)
-	: Super(ObjectInitializer), RemovedPinArrayIndex(INDEX_NONE)
+	: Super(ObjectInitializer)
 {
 }
 
@@ -26,6 +35,103 @@ FString UAnimGraphNode_MDA::GetNodeCategory() const
 	return TEXT("Blends");
 }
 
+void UAnimGraphNode_MDA::OnProcessDuringCompilation(IAnimBlueprintCompilationContext& InCompilationContext, IAnimBlueprintGeneratedClassCompiledData& OutCompiledData)
+{
+	Super::OnProcessDuringCompilation(InCompilationContext, OutCompiledData);
+
+	// Lets the runtime node fuse the chain and build sharing keys without checking the type of the linked nodes
+	const UEdGraphNode* BaseNode = GetLinkedNode(FindPin(GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, BasePose), EGPD_Input));
+	Node.bBasePoseIsMDA = BaseNode && BaseNode->IsA<UAnimGraphNode_MDA>();
+	Node.bBasePoseIsSequencePlayer = BaseNode && BaseNode->IsA<UAnimGraphNode_SequencePlayer>();
+
+	Node.PoseIsSequencePlayer.SetNumZeroed(Node.Poses.Num());
+	for (int32 PoseIndex = 0; PoseIndex < Node.Poses.Num(); ++PoseIndex)
+	{
+		const UEdGraphNode* LayerNode = GetLinkedNode(FindPin(FString::Printf(TEXT("%s_%d"), GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, Poses), PoseIndex), EGPD_Input));
+		Node.PoseIsSequencePlayer[PoseIndex] = LayerNode && LayerNode->IsA<UAnimGraphNode_SequencePlayer>();
+	}
+
+	// Lets the runtime node skip the exposed inputs when no input pin is linked or bound
+	Node.bHasLinkedWeights = false;
+	Node.bHasLinkedInputs = false;
+	for (const UEdGraphPin* Pin : Pins)
+	{
+		if (Pin->Direction != EGPD_Input || UAnimationGraphSchema::IsPosePin(Pin->PinType) || (Pin->LinkedTo.Num() == 0 && !HasBinding(Pin->GetFName())))
+		{
+			continue;
+		}
+
+		FProperty* AssociatedProperty;
+		int32 ArrayIndex;
+		GetPinAssociatedProperty(GetFNodeType(), Pin, /*out*/ AssociatedProperty, /*out*/ ArrayIndex);
+		if (AssociatedProperty && AssociatedProperty->GetFName() == GET_MEMBER_NAME_CHECKED(FAnimNode_MDA, BlendWeights))
+		{
+			Node.bHasLinkedWeights = true;
+		}
+		else
+		{
+			Node.bHasLinkedInputs = true;
+		}
+	}
+}
+
+void UAnimGraphNode_MDA::CustomizePinData(UEdGraphPin* Pin, FName SourcePropertyName, int32 ArrayIndex) const
+{
+	Super::CustomizePinData(Pin, SourcePropertyName, ArrayIndex);
+
+	// a weight bound to a curve or property never reads its pin
+	if (SourcePropertyName == GET_MEMBER_NAME_CHECKED(FAnimNode_MDA, BlendWeights) && Node.LayerSettings.IsValidIndex(ArrayIndex))
+	{
+		Pin->bHidden = Node.LayerSettings[ArrayIndex].WeightSource != EMDAWeightSource::Pin;
+	}
+}
+
+void UAnimGraphNode_MDA::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	const bool bWeightSourceChanged = PropertyChangedEvent.GetPropertyName() == GET_MEMBER_NAME_CHECKED(FMDALayerSettings, WeightSource)
+		|| PropertyChangedEvent.GetPropertyName() == GET_MEMBER_NAME_CHECKED(FAnimNode_MDA, LayerSettings);
+
+	// the weight pins of bound layers are hidden, so their links would be copied for nothing
+	if (bWeightSourceChanged)
+	{
+		for (int32 PoseIndex = 0; PoseIndex < Node.LayerSettings.Num(); ++PoseIndex)
+		{
+			UEdGraphPin* WeightPin = FindPin(FString::Printf(TEXT("%s_%d"), GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, BlendWeights), PoseIndex), EGPD_Input);
+			if (WeightPin && Node.LayerSettings[PoseIndex].WeightSource != EMDAWeightSource::Pin)
+			{
+				WeightPin->BreakAllPinLinks(true);
+			}
+		}
+	}
+
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	if (bWeightSourceChanged)
+	{
+		ReconstructNode();
+	}
+}
+
+UEdGraphNode* UAnimGraphNode_MDA::GetLinkedNode(const UEdGraphPin* InputPin)
+{
+	// Find the node linked to the pin, skipping reroute nodes
+	const UEdGraphPin* LinkedPin = InputPin && InputPin->LinkedTo.Num() == 1 ? InputPin->LinkedTo[0] : nullptr;
+
+	while (LinkedPin)
+	{
+		const UK2Node_Knot* Knot = Cast<UK2Node_Knot>(LinkedPin->GetOwningNode());
+		if (!Knot)
+		{
+			break;
+		}
+
+		const UEdGraphPin* KnotInputPin = Knot->GetInputPin();
+		LinkedPin = KnotInputPin->LinkedTo.Num() == 1 ? KnotInputPin->LinkedTo[0] : nullptr;
+	}
+
+	return LinkedPin ? LinkedPin->GetOwningNode() : nullptr;
+}
+
 FLinearColor UAnimGraphNode_MDA::GetNodeTitleColor() const
 {
 	return FLinearColor(67/255.0f, 142/255.0f, 255/255.0f);
@@ -92,38 +198,225 @@ void UAnimGraphNode_MDA::GetNodeContextMenuActions(UToolMenu* Menu, UGraphNodeCo
 	else
 	{
 		Section.AddMenuEntryWithCommandList(FMDACommands::Get().AddBlendListPin, MDACommandList);
+		Section.AddMenuEntryWithCommandList(FMDACommands::Get().BakeStaticLayers, MDACommandList);
 	}
 }
 
 void UAnimGraphNode_MDA::AddPinToBlendNode()
+{
+	AddPinsToBlendNode(1);
+}
+
+void UAnimGraphNode_MDA::RemovePinFromBlendNode(UEdGraphPin* Pin)
+{
+	FProperty* AssociatedProperty;
+	int32 ArrayIndex;
+	GetPinAssociatedProperty(GetFNodeType(), Pin, /*out*/ AssociatedProperty, /*out*/ ArrayIndex);
+
+	if (ArrayIndex != INDEX_NONE)
+	{
+		RemovePinsFromBlendNode(MakeArrayView(&ArrayIndex, 1));
+	}
+}
+
+void UAnimGraphNode_MDA::AddPinsToBlendNode(int32 Count)
 {
 	FScopedTransaction Transaction(LOCTEXT("AddMDAPin", "AddMDAPin"));
 	Modify();
 
-	Node.AddPose();
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		Node.AddPose();
+	}
+
+	// new pins are appended, the old pins keep their names
 	ReconstructNode();
 	FBlueprintEditorUtils::MarkBlueprintAsStructurallyModified(GetBlueprint());
 }
 
-void UAnimGraphNode_MDA::RemovePinFromBlendNode(UEdGraphPin* Pin)
+void UAnimGraphNode_MDA::RemovePinsFromBlendNode(TArrayView<const int32> PoseIndices)
+{
+	TBitArray<> Removed(false, Node.Poses.Num());
+	for (const int32 PoseIndex : PoseIndices)
+	{
+		if (Removed.IsValidIndex(PoseIndex))
+		{
+			Removed[PoseIndex] = true;
+		}
+	}
+
+	TArray<int32, TInlineAllocator<64>> NewOrder;
+	for (int32 PoseIndex = 0; PoseIndex < Node.Poses.Num(); ++PoseIndex)
+	{
+		if (!Removed[PoseIndex])
+		{
+			NewOrder.Add(PoseIndex);
+		}
+	}
+
+	if (NewOrder.Num() != Node.Poses.Num())
+	{
+		FScopedTransaction Transaction(LOCTEXT("RemoveMDAPin", "RemoveMDAPin"));
+		RemapPins(NewOrder);
+	}
+}
+
+void UAnimGraphNode_MDA::ReorderPinsOfBlendNode(TArrayView<const int32> NewOrder)
+{
+	// has to be a permutation of the poses
+	TBitArray<> Used(false, Node.Poses.Num());
+	for (const int32 OldIndex : NewOrder)
+	{
+		if (!Used.IsValidIndex(OldIndex) || Used[OldIndex])
+		{
+			return;
+		}
+		Used[OldIndex] = true;
+	}
+
+	if (NewOrder.Num() == Node.Poses.Num())
+	{
+		FScopedTransaction Transaction(LOCTEXT("ReorderMDAPins", "ReorderMDAPins"));
+		RemapPins(NewOrder);
+	}
+}
+
+void UAnimGraphNode_MDA::RemapPins(TArrayView<const int32> NewOrder)
 {
-	FScopedTransaction Transaction(LOCTEXT("RemoveMDAPin", "RemoveMDAPin"));
 	Modify();
 
-	FProperty* AssociatedProperty;
-	int32 ArrayIndex;
-	GetPinAssociatedProperty(GetFNodeType(), Pin, /*out*/ AssociatedProperty, /*out*/ ArrayIndex);
+	// old pin index to new pin index, read when the old pins are matched to the new ones
+	PinRemap.Init(INDEX_NONE, Node.Poses.Num());
+	for (int32 NewIndex = 0; NewIndex < NewOrder.Num(); ++NewIndex)
+	{
+		PinRemap[NewOrder[NewIndex]] = NewIndex;
+	}
 
-	if (ArrayIndex != INDEX_NONE)
+	Node.RemapPoses(NewOrder);
+	ReconstructNode();
+	FBlueprintEditorUtils::MarkBlueprintAsStructurallyModified(GetBlueprint());
+}
+
+void UAnimGraphNode_MDA::BakeStaticLayers()
+{
+	TArray<FMDABakeLayer> Layers;
+	TArray<FText> Skipped;
+	FMDALayerBaker::GatherLayers(*this, Layers, Skipped);
+
+	FTextBuilder Message;
+	USkeleton* Skeleton = GetAnimBlueprint()->TargetSkeleton;
+	if (Layers.Num() < 2 || !Skeleton)
 	{
-		//@TODO: ANIMREFACTOR: Need to handle moving pins below up correctly
-		// setting up removed pins info
-		RemovedPinArrayIndex = ArrayIndex;
-		Node.RemovePose(ArrayIndex);
-		// removes the selected pin and related properties in reconstructNode()
-		// @TODO: Considering passing "RemovedPinArrayIndex" to ReconstructNode as the argument
-		ReconstructNode();
-		FBlueprintEditorUtils::MarkBlueprintAsStructurallyModified(GetBlueprint());
+		Message.AppendLine(LOCTEXT("NothingToBake", "Baking needs at least two adjacent sequence layers playing in sync at constant weights."));
+		for (const FText& Reason : Skipped)
+		{
+			Message.AppendLine(Reason);
+		}
+		FMessageDialog::Open(EAppMsgType::Ok, Message.ToText());
+		return;
+	}
+
+	UAnimSequence* BakedSequence = FMDALayerBaker::Bake(*Skeleton, Layers);
+	const FMDABakeReport Report = FMDALayerBaker::Verify(*this, *Skeleton, Layers, *BakedSequence);
+
+	Message.AppendLineFormat(LOCTEXT("Baked", "Baked layers {0} to {1}."), Layers[0].PoseIndex, Layers.Last().PoseIndex);
+	Message.AppendLineFormat(LOCTEXT("Verified", "Compared the node with its {0} sequence layers and with the baked layer in their place, on {1}, at {2} samples: max translation error {3}, max rotation error {4} rad, worst at {5} on {6}."),
+		Report.NumLayers, Report.bBaseFromGraph ? LOCTEXT("BaseFromGraph", "its base pose sequence") : LOCTEXT("OffsetBase", "the reference pose with random offsets"),
+		Report.NumSamples, Report.MaxTranslationError, Report.MaxRotationError, Report.WorstTime, FText::FromName(Report.WorstBone));
+	if (Report.NumLayersLeftOut > 0)
+	{
+		Message.AppendLineFormat(LOCTEXT("LayersLeftOut", "{0} layers not linked to sequence players at constant weights were left out of the comparison."), Report.NumLayersLeftOut);
+	}
+	for (const FText& Reason : Skipped)
+	{
+		Message.AppendLine(Reason);
+	}
+	Message.AppendLine(LOCTEXT("ReplaceLayers", "Replace the layers with the baked sequence?"));
+
+	UE_LOG(LogMDA, Log, TEXT("%s"), *Message.ToText().ToString());
+
+	if (FMessageDialog::Open(EAppMsgType::YesNo, Message.ToText()) == EAppReturnType::Yes)
+	{
+		FMDALayerBaker::SaveAsAsset(*BakedSequence, Layers);
+		ReplaceBakedLayers(Layers, BakedSequence);
+	}
+	else
+	{
+		BakedSequence->MarkAsGarbage();
+	}
+}
+
+void UAnimGraphNode_MDA::ReplaceBakedLayers(TArrayView<const FMDABakeLayer> Layers, UAnimSequence* BakedSequence)
+{
+	FScopedTransaction Transaction(LOCTEXT("BakeMDALayers", "Bake MDA Layers"));
+	Modify();
+
+	UEdGraph* Graph = GetGraph();
+	Graph->Modify();
+
+	// the first layer plays the baked sequence with the settings of its player
+	const FMDABakeLayer& FirstLayer = Layers[0];
+
+	FGraphNodeCreator<UAnimGraphNode_SequencePlayer> PlayerCreator(*Graph);
+	UAnimGraphNode_SequencePlayer* BakedPlayer = PlayerCreator.CreateNode();
+	BakedPlayer->NodePosX = FirstLayer.Player->NodePosX;
+	BakedPlayer->NodePosY = FirstLayer.Player->NodePosY;
+	PlayerCreator.Finalize();
+
+	BakedPlayer->Node = FirstLayer.Player->Node;
+	BakedPlayer->Node.SetSequence(BakedSequence);
+	BakedPlayer->ReconstructNode();
+
+	UEdGraphPin* PosePin = FindPin(FString::Printf(TEXT("%s_%d"), GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, Poses), FirstLayer.PoseIndex), EGPD_Input);
+	PosePin->BreakAllPinLinks(true);
+	GetSchema()->TryCreateConnection(BakedPlayer->FindPin(TEXT("Pose"), EGPD_Output), PosePin);
+
+	uint8 Priority = 0;
+	for (const FMDABakeLayer& Layer : Layers)
+	{
+		Priority = FMath::Max(Priority, Layer.Priority);
+	}
+
+	Node.BlendWeights[FirstLayer.PoseIndex] = 1.f;
+	Node.BlendModes[FirstLayer.PoseIndex] = EMDABlendMode::Add;
+	Node.LayerSettings[FirstLayer.PoseIndex] = FMDALayerSettings();
+	Node.LayerSettings[FirstLayer.PoseIndex].Priority = Priority;
+
+	// remove the other layers
+	TArray<int32, TInlineAllocator<8>> RemovedPoseIndices;
+	for (int32 LayerIndex = 1; LayerIndex < Layers.Num(); ++LayerIndex)
+	{
+		RemovedPoseIndices.Add(Layers[LayerIndex].PoseIndex);
+	}
+	RemovePinsFromBlendNode(RemovedPoseIndices);
+
+	// players that fed nothing else are no longer needed
+	TArray<UAnimGraphNode_SequencePlayer*, TInlineAllocator<8>> Players;
+	for (const FMDABakeLayer& Layer : Layers)
+	{
+		Players.AddUnique(Layer.Player);
+	}
+
+	for (UAnimGraphNode_SequencePlayer* Player : Players)
+	{
+		const UEdGraphPin* OutputPin = Player->FindPin(TEXT("Pose"), EGPD_Output);
+		if (!OutputPin || OutputPin->LinkedTo.Num() == 0)
+		{
+			FBlueprintEditorUtils::RemoveNode(GetBlueprint(), Player, true);
+		}
+	}
+
+	FBlueprintEditorUtils::MarkBlueprintAsStructurallyModified(GetBlueprint());
+}
+
+void UAnimGraphNode_MDA::CopyNodeDataToPreviewNode(FAnimNode_Base* InPreviewNode)
+{
+	FAnimNode_MDA* PreviewNode = static_cast<FAnimNode_MDA*>(InPreviewNode);
+
+	// the pin count is fixed while previewing, layers are only added by reconstruction
+	if (PreviewNode->BlendModes.Num() == Node.BlendModes.Num())
+	{
+		PreviewNode->BlendModes = Node.BlendModes;
 	}
 }
 
@@ -145,70 +438,48 @@ void UAnimGraphNode_MDA::ReallocatePinsDuringReconstruction(TArray<UEdGraphPin*>
 {
 	Super::ReallocatePinsDuringReconstruction(OldPins);
 
-	// Delete Pins by removed pin info 
-	if (RemovedPinArrayIndex != INDEX_NONE)
+	// Rename and delete old pins by the pin remap
+	if (PinRemap.Num() > 0)
 	{
-		RemovePinsFromOldPins(OldPins, RemovedPinArrayIndex);
-		// Clears removed pin info to avoid to remove multiple times
-		// @TODO : Considering receiving RemovedPinArrayIndex as an argument of ReconstructNode()
-		RemovedPinArrayIndex = INDEX_NONE;
+		RemapOldPins(OldPins);
+		// Clears the remap to avoid to apply it multiple times
+		PinRemap.Reset();
 	}
 }
 
-void UAnimGraphNode_MDA::RemovePinsFromOldPins(TArray<UEdGraphPin*>& OldPins, int32 RemovedArrayIndex)
+void UAnimGraphNode_MDA::RemapOldPins(TArray<UEdGraphPin*>& OldPins) const
 {
-	TArray<FString> RemovedPropertyNames;
-	TArray<FName> NewPinNames;
-
-	// Store new pin names to compare with old pin names
-	for (const auto& Pin : Pins)
+	// arrayed properties of the node, whose pins are named <Property>_<Index>
+	static const TArray<FName> ArrayPropertyNames = []()
 	{
-		NewPinNames.Add(Pin->PinName);
-	}
-
-	// don't know which pins are removed yet so find removed pins comparing NewPins and OldPins
-	for (const auto& Pin : OldPins)
-	{
-		const FName OldPinName = Pin->PinName;
-		if (!NewPinNames.Contains(OldPinName))
+		TArray<FName> Names;
+		for (TFieldIterator<FArrayProperty> It(FAnimNode_MDA::StaticStruct()); It; ++It)
 		{
-			const FString OldPinNameStr = OldPinName.ToString();
-			const int32 UnderscoreIndex = OldPinNameStr.Find(TEXT("_"), ESearchCase::CaseSensitive);
-			if (UnderscoreIndex != INDEX_NONE)
-			{
-				FString PropertyName = OldPinNameStr.Left(UnderscoreIndex);
-				RemovedPropertyNames.Add(MoveTemp(PropertyName));
-			}
+			Names.Add(It->GetFName());
 		}
-	}
+		return Names;
+	}();
 
-	for (int32 PinIdx = 0; PinIdx < OldPins.Num(); PinIdx++)
+	int32 NumKeptPins = 0;
+	for (UEdGraphPin* Pin : OldPins)
 	{
-		// Separate the pin name into property name and index
-		const FString OldPinNameStr = OldPins[PinIdx]->PinName.ToString();
-
-		const int32 UnderscoreIndex = OldPinNameStr.Find(TEXT("_"), ESearchCase::CaseSensitive);
-		if (UnderscoreIndex != INDEX_NONE)
+		// FName stores a trailing _<Index> as the number Index + 1, so the name is never parsed
+		const int32 OldIndex = Pin->PinName.GetNumber() - 1;
+		if (PinRemap.IsValidIndex(OldIndex) && ArrayPropertyNames.Contains(FName(Pin->PinName, NAME_NO_NUMBER_INTERNAL)))
 		{
-			const FString PropertyName = OldPinNameStr.Left(UnderscoreIndex);
-
-			if (RemovedPropertyNames.Contains(PropertyName))
+			const int32 NewIndex = PinRemap[OldIndex];
+			if (NewIndex == INDEX_NONE)
 			{
-				const int32 ArrayIndex = FCString::Atoi(*(OldPinNameStr.Mid(UnderscoreIndex + 1)));
-				// if array index is matched, removes pins 
-				// and if array index is greater than removed index, decrease index
-				if (ArrayIndex == RemovedArrayIndex)
-				{
-					OldPins[PinIdx]->MarkAsGarbage();
-					OldPins.RemoveAt(PinIdx);
-					--PinIdx;
-				}
-				else if (ArrayIndex > RemovedArrayIndex)
-				{
-					OldPins[PinIdx]->PinName = *FString::Printf(TEXT("%s_%d"), *PropertyName, ArrayIndex - 1);
-				}
+				Pin->MarkAsGarbage();
+				continue;
 			}
+
+			Pin->PinName = FName(Pin->PinName, NewIndex + 1);
 		}
+
+		OldPins[NumKeptPins++] = Pin;
 	}
+
+	OldPins.SetNum(NumKeptPins, false);
 }
 #undef LOCTEXT_NAMESPACE
@@ -8,6 +8,7 @@ void FMDACommands::RegisterCommands()
 {
 	UI_COMMAND( AddBlendListPin, "Add Blend Pin", "Add blend pin to blend list", EUserInterfaceActionType::Button, FInputChord() )
 	UI_COMMAND( RemoveBlendListPin, "Remove Blend Pin", "Remove blend pin", EUserInterfaceActionType::Button, FInputChord() )
+	UI_COMMAND( BakeStaticLayers, "Bake Static Layers", "Bake the sequence layers playing in sync at constant weights into one additive sequence", EUserInterfaceActionType::Button, FInputChord() )
 }
 
 #undef LOCTEXT_NAMESPACE
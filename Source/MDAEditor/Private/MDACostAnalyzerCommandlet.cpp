@@ -0,0 +1,329 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#include "MDACostAnalyzerCommandlet.h"
+#include "AnimGraphNode_MDA.h"
+#include "AnimGraphNode_SequencePlayer.h"
+#include "MDALayerSet.h"
+#include "MDARuntime.h"
+#include "Animation/AnimBlueprint.h"
+#include "Animation/AnimSequenceBase.h"
+#include "Animation/Skeleton.h"
+#include "AssetRegistry/AssetRegistryModule.h"
+#include "Dom/JsonObject.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+
+#ifdef UE_INLINE_GENERATED_CPP_BY_NAME
+#include UE_INLINE_GENERATED_CPP_BY_NAME(MDACostAnalyzerCommandlet)
+#endif
+
+namespace MDACostAnalyzer
+{
+	struct FCostConstants
+	{
+		// accumulation of one bone by one layer
+		double NsPerBoneLayer = 4.0;
+		// evaluating and pushing one layer, without its input graph
+		double NsPerLayer = 300.0;
+		// blending one curve of one layer
+		double NsPerCurveLayer = 2.0;
+	};
+
+	struct FNodeReport
+	{
+		FString Blueprint;
+		FString Graph;
+		FString Node;
+		int32 NumBones = 0;
+		int32 NumSkeletonCurves = 0;
+		int32 NumLayers = 0;
+		int32 NumAdd = 0;
+		int32 NumSubtract = 0;
+		int32 NumCoDAdd = 0;
+		int32 NumZeroLayers = 0;
+		int32 NumUnlinkedLayers = 0;
+		int32 NumBoundLayers = 0;
+		int32 NumLayerSetLayers = 0;
+		int32 NumLayerCurves = 0;
+		int32 ChainDepth = 0;
+		int32 NumActiveLayers = 0;
+
+		// pose layers of Events nodes are only evaluated while activated, so the cost is a range
+		bool bEventActivation = false;
+		double EstimatedMinUs = 0.0;
+		double EstimatedUs = 0.0;
+	};
+
+	FString GetPinName(const TCHAR* PropertyName, int32 PoseIndex)
+	{
+		return FString::Printf(TEXT("%s_%d"), PropertyName, PoseIndex);
+	}
+
+	// Number of MDA nodes linked below the node by base poses
+	int32 GetChainDepth(const UAnimGraphNode_MDA& MDANode)
+	{
+		int32 Depth = 0;
+		const UAnimGraphNode_MDA* BaseNode = &MDANode;
+		while ((BaseNode = Cast<UAnimGraphNode_MDA>(UAnimGraphNode_MDA::GetLinkedNode(BaseNode->FindPin(GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, BasePose), EGPD_Input)))) != nullptr)
+		{
+			// cycles don't compile, but the graph may be broken
+			if (++Depth > 256)
+			{
+				break;
+			}
+		}
+		return Depth;
+	}
+
+	FNodeReport AnalyzeNode(const UAnimBlueprint& Blueprint, const UEdGraph& Graph, const UAnimGraphNode_MDA& MDANode, const FCostConstants& Constants)
+	{
+		const FAnimNode_MDA& Node = MDANode.Node;
+
+		FNodeReport Report;
+		Report.Blueprint = Blueprint.GetPathName();
+		Report.Graph = Graph.GetName();
+		Report.Node = MDANode.NodeGuid.ToString();
+		Report.ChainDepth = GetChainDepth(MDANode);
+
+		if (const USkeleton* Skeleton = Blueprint.TargetSkeleton)
+		{
+			Report.NumBones = Skeleton->GetReferenceSkeleton().GetNum();
+			if (const FSmartNameMapping* CurveMapping = Skeleton->GetSmartNameContainer(USkeleton::AnimCurveMappingName))
+			{
+				Report.NumSkeletonCurves = CurveMapping->GetNum();
+			}
+		}
+
+		FInputScaleBiasClamp AlphaScaleBiasClamp = Node.AlphaScaleBiasClamp;
+		Report.NumLayers = Node.Poses.Num();
+		Report.bEventActivation = Node.ActivationMode == EMDAActivationMode::Events;
+
+		for (int32 PoseIndex = 0; PoseIndex < Node.Poses.Num(); ++PoseIndex)
+		{
+			switch (Node.BlendModes.IsValidIndex(PoseIndex) ? Node.BlendModes[PoseIndex] : EMDABlendMode::Add)
+			{
+				case EMDABlendMode::Add: ++Report.NumAdd; break;
+				case EMDABlendMode::Subtract: ++Report.NumSubtract; break;
+				case EMDABlendMode::CoDAdd: ++Report.NumCoDAdd; break;
+				default: break;
+			}
+
+			const UEdGraphPin* PosePin = MDANode.FindPin(GetPinName(GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, Poses), PoseIndex), EGPD_Input);
+			if (!PosePin || PosePin->LinkedTo.Num() == 0)
+			{
+				++Report.NumUnlinkedLayers;
+				continue;
+			}
+
+			const EMDAWeightSource WeightSource = Node.LayerSettings.IsValidIndex(PoseIndex) ? Node.LayerSettings[PoseIndex].WeightSource : EMDAWeightSource::Pin;
+			const UEdGraphPin* WeightPin = MDANode.FindPin(GetPinName(GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, BlendWeights), PoseIndex), EGPD_Input);
+			const bool bWeightLinked = WeightSource != EMDAWeightSource::Pin || (WeightPin && WeightPin->LinkedTo.Num() > 0);
+			if (bWeightLinked)
+			{
+				++Report.NumBoundLayers;
+			}
+			else if (!AlphaScaleBiasClamp.bInterpResult && !FAnimWeight::IsRelevant(AlphaScaleBiasClamp.ApplyTo(Node.BlendWeights[PoseIndex], 0.f)))
+			{
+				// never evaluated
+				++Report.NumZeroLayers;
+				continue;
+			}
+
+			++Report.NumActiveLayers;
+
+			if (const UAnimGraphNode_SequencePlayer* Player = Cast<UAnimGraphNode_SequencePlayer>(UAnimGraphNode_MDA::GetLinkedNode(PosePin)))
+			{
+				if (const UAnimSequenceBase* Sequence = Cast<UAnimSequenceBase>(Player->GetAnimationAsset()))
+				{
+					Report.NumLayerCurves += Sequence->GetCurveData().FloatCurves.Num();
+				}
+			}
+		}
+
+		// layer set layers are always on, they are dropped at activation when they would never contribute
+		const int32 NumActivePoseLayers = Report.NumActiveLayers;
+		if (Node.LayerSet)
+		{
+			Report.NumLayerSetLayers = Node.LayerSet->Layers.Num();
+			for (const FMDALayerSetEntry& Entry : Node.LayerSet->Layers)
+			{
+				if (!Entry.Sequence || !FAnimWeight::IsRelevant(Entry.Weight))
+				{
+					++Report.NumZeroLayers;
+					continue;
+				}
+
+				++Report.NumActiveLayers;
+				Report.NumLayerCurves += Entry.Sequence->GetCurveData().FloatCurves.Num();
+			}
+		}
+
+		// layers whose weights are bound are counted as evaluated every frame. Curves are blended over all skeleton curves
+		const double NsPerActiveLayer = Constants.NsPerLayer + Report.NumBones * Constants.NsPerBoneLayer + Report.NumSkeletonCurves * Constants.NsPerCurveLayer;
+		Report.EstimatedUs = Report.NumActiveLayers * NsPerActiveLayer / 1000.0;
+		Report.EstimatedMinUs = Report.bEventActivation ? (Report.NumActiveLayers - NumActivePoseLayers) * NsPerActiveLayer / 1000.0 : Report.EstimatedUs;
+
+		return Report;
+	}
+
+	// Names can contain commas and quotes, so text fields are quoted with embedded quotes doubled
+	FString QuoteCsv(const FString& Field)
+	{
+		return TEXT("\"") + Field.Replace(TEXT("\""), TEXT("\"\"")) + TEXT("\"");
+	}
+
+	FString ToCsv(TArrayView<const FNodeReport> Reports)
+	{
+		FString Csv = TEXT("Blueprint,Graph,Node,Activation,EstimatedMinUs,EstimatedUs,Bones,SkeletonCurves,Layers,ActiveLayers,Add,Subtract,CoDAdd,ZeroLayers,UnlinkedLayers,BoundLayers,LayerSetLayers,LayerCurves,ChainDepth\n");
+		for (const FNodeReport& Report : Reports)
+		{
+			Csv += FString::Printf(TEXT("%s,%s,%s,%s,%.3f,%.3f,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n"),
+				*QuoteCsv(Report.Blueprint), *QuoteCsv(Report.Graph), *QuoteCsv(Report.Node), Report.bEventActivation ? TEXT("Events") : TEXT("Weights"), Report.EstimatedMinUs, Report.EstimatedUs, Report.NumBones, Report.NumSkeletonCurves,
+				Report.NumLayers, Report.NumActiveLayers, Report.NumAdd, Report.NumSubtract, Report.NumCoDAdd,
+				Report.NumZeroLayers, Report.NumUnlinkedLayers, Report.NumBoundLayers, Report.NumLayerSetLayers, Report.NumLayerCurves, Report.ChainDepth);
+		}
+		return Csv;
+	}
+
+	FString ToJson(TArrayView<const FNodeReport> Reports, const FCostConstants& Constants)
+	{
+		TArray<TSharedPtr<FJsonValue>> Nodes;
+		for (const FNodeReport& Report : Reports)
+		{
+			const TSharedRef<FJsonObject> Object = MakeShared<FJsonObject>();
+			Object->SetStringField(TEXT("Blueprint"), Report.Blueprint);
+			Object->SetStringField(TEXT("Graph"), Report.Graph);
+			Object->SetStringField(TEXT("Node"), Report.Node);
+			Object->SetStringField(TEXT("Activation"), Report.bEventActivation ? TEXT("Events") : TEXT("Weights"));
+			Object->SetNumberField(TEXT("EstimatedMinUs"), Report.EstimatedMinUs);
+			Object->SetNumberField(TEXT("EstimatedUs"), Report.EstimatedUs);
+			Object->SetNumberField(TEXT("Bones"), Report.NumBones);
+			Object->SetNumberField(TEXT("SkeletonCurves"), Report.NumSkeletonCurves);
+			Object->SetNumberField(TEXT("Layers"), Report.NumLayers);
+			Object->SetNumberField(TEXT("ActiveLayers"), Report.NumActiveLayers);
+			Object->SetNumberField(TEXT("Add"), Report.NumAdd);
+			Object->SetNumberField(TEXT("Subtract"), Report.NumSubtract);
+			Object->SetNumberField(TEXT("CoDAdd"), Report.NumCoDAdd);
+			Object->SetNumberField(TEXT("ZeroLayers"), Report.NumZeroLayers);
+			Object->SetNumberField(TEXT("UnlinkedLayers"), Report.NumUnlinkedLayers);
+			Object->SetNumberField(TEXT("BoundLayers"), Report.NumBoundLayers);
+			Object->SetNumberField(TEXT("LayerSetLayers"), Report.NumLayerSetLayers);
+			Object->SetNumberField(TEXT("LayerCurves"), Report.NumLayerCurves);
+			Object->SetNumberField(TEXT("ChainDepth"), Report.ChainDepth);
+			Nodes.Add(MakeShared<FJsonValueObject>(Object));
+		}
+
+		const TSharedRef<FJsonObject> Root = MakeShared<FJsonObject>();
+		Root->SetNumberField(TEXT("NsPerBoneLayer"), Constants.NsPerBoneLayer);
+		Root->SetNumberField(TEXT("NsPerLayer"), Constants.NsPerLayer);
+		Root->SetNumberField(TEXT("NsPerCurveLayer"), Constants.NsPerCurveLayer);
+		Root->SetArrayField(TEXT("Nodes"), Nodes);
+
+		FString Json;
+		const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+		FJsonSerializer::Serialize(Root, Writer);
+		return Json;
+	}
+}
+
+UMDACostAnalyzerCommandlet::UMDACostAnalyzerCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+}
+
+int32 UMDACostAnalyzerCommandlet::Main(const FString& Params)
+{
+	using namespace MDACostAnalyzer;
+
+	FString Path = TEXT("/Game");
+	FParse::Value(*Params, TEXT("Path="), Path);
+
+	FString OutFile = FPaths::ProjectSavedDir() / TEXT("Profiling/MDA/MDACostReport.csv");
+	FParse::Value(*Params, TEXT("Out="), OutFile);
+
+	FCostConstants Constants;
+	FParse::Value(*Params, TEXT("NsPerBoneLayer="), Constants.NsPerBoneLayer);
+	FParse::Value(*Params, TEXT("NsPerLayer="), Constants.NsPerLayer);
+	FParse::Value(*Params, TEXT("NsPerCurveLayer="), Constants.NsPerCurveLayer);
+
+	IAssetRegistry& AssetRegistry = FModuleManager::LoadModuleChecked<FAssetRegistryModule>(TEXT("AssetRegistry")).Get();
+	AssetRegistry.SearchAllAssets(true);
+
+	FARFilter Filter;
+	Filter.ClassPaths.Add(UAnimBlueprint::StaticClass()->GetClassPathName());
+	Filter.bRecursiveClasses = true;
+	Filter.PackagePaths.Add(*Path);
+	Filter.bRecursivePaths = true;
+
+	TArray<FAssetData> Assets;
+	AssetRegistry.GetAssets(Filter, Assets);
+
+	TArray<FNodeReport> Reports;
+	for (const FAssetData& Asset : Assets)
+	{
+		const UAnimBlueprint* Blueprint = Cast<UAnimBlueprint>(Asset.GetAsset());
+		if (!Blueprint)
+		{
+			UE_LOG(LogMDA, Warning, TEXT("Failed to load %s"), *Asset.GetObjectPathString());
+			continue;
+		}
+
+		TArray<UEdGraph*> Graphs;
+		Blueprint->GetAllGraphs(Graphs);
+		for (const UEdGraph* Graph : Graphs)
+		{
+			for (const UEdGraphNode* GraphNode : Graph->Nodes)
+			{
+				if (const UAnimGraphNode_MDA* MDANode = Cast<UAnimGraphNode_MDA>(GraphNode))
+				{
+					Reports.Add(AnalyzeNode(*Blueprint, *Graph, *MDANode, Constants));
+				}
+			}
+		}
+
+		// blueprints are only read, so memory can be released while scanning large projects
+		CollectGarbage(RF_NoFlags);
+	}
+
+	Reports.Sort([](const FNodeReport& A, const FNodeReport& B)
+	{
+		return A.EstimatedUs > B.EstimatedUs;
+	});
+
+	const FString Output = FPaths::GetExtension(OutFile).Equals(TEXT("json"), ESearchCase::IgnoreCase) ? ToJson(Reports, Constants) : ToCsv(Reports);
+	if (!FFileHelper::SaveStringToFile(Output, *OutFile))
+	{
+		UE_LOG(LogMDA, Error, TEXT("Failed to write %s"), *OutFile);
+		return 1;
+	}
+
+	double TotalMinUs = 0.0;
+	double TotalUs = 0.0;
+	int32 NumEventNodes = 0;
+	for (const FNodeReport& Report : Reports)
+	{
+		TotalMinUs += Report.EstimatedMinUs;
+		TotalUs += Report.EstimatedUs;
+		NumEventNodes += Report.bEventActivation ? 1 : 0;
+	}
+
+	UE_LOG(LogMDA, Display, TEXT("%d MDA nodes (%d activated by events) in %d anim blueprints, %.1f - %.1f us estimated in total, written to %s"), Reports.Num(), NumEventNodes, Assets.Num(), TotalMinUs, TotalUs, *OutFile);
+	for (int32 Index = 0; Index < FMath::Min(Reports.Num(), 10); ++Index)
+	{
+		const FNodeReport& Report = Reports[Index];
+		if (Report.bEventActivation)
+		{
+			UE_LOG(LogMDA, Display, TEXT("  %8.1f us  %s (%s), up to %d active layers of %d, %.1f us with no layer activated"), Report.EstimatedUs, *Report.Blueprint, *Report.Graph, Report.NumActiveLayers, Report.NumLayers, Report.EstimatedMinUs);
+		}
+		else
+		{
+			UE_LOG(LogMDA, Display, TEXT("  %8.1f us  %s (%s), %d active layers of %d"), Report.EstimatedUs, *Report.Blueprint, *Report.Graph, Report.NumActiveLayers, Report.NumLayers);
+		}
+	}
+
+	return 0;
+}
@@ -45,6 +45,11 @@ void FMDAEditorModule::OnCreateMDACommands()
 	FExecuteAction::CreateRaw( this, &FMDAEditorModule::OnRemovePosePin ),
 	FCanExecuteAction::CreateRaw( this, &FMDAEditorModule::CanRemovePosePin )
 	);
+
+	// Bake static layers
+	MDACommandList->MapAction( FMDACommands::Get().BakeStaticLayers,
+	FExecuteAction::CreateRaw( this, &FMDAEditorModule::OnBakeStaticLayers )
+	);
 }
 
 FBlueprintEditor* FMDAEditorModule::GetFocusedBlueprintEditor()
@@ -108,6 +113,21 @@ void FMDAEditorModule::OnRemovePosePin()
 	FocusedGraphEd->NotifyGraphChanged();
 }
 
+void FMDAEditorModule::OnBakeStaticLayers()
+{
+	// Get current focused graph editor
+	const TSharedPtr<SGraphEditor> FocusedGraphEd = GetFocusedGraphEditor();
+
+	// Get the selected node
+	UAnimGraphNode_MDA* MDANode = Cast<UAnimGraphNode_MDA>(FocusedGraphEd->GetGraphNodeForMenu());
+
+	// Bake
+	MDANode->BakeStaticLayers();
+
+	// Update the graph so that the node will be refreshed
+	FocusedGraphEd->NotifyGraphChanged();
+}
+
 #undef LOCTEXT_NAMESPACE
 
 IMPLEMENT_MODULE(FMDAEditorModule, MDAEditor)
@@ -0,0 +1,465 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#include "MDALayerBaker.h"
+#include "AnimGraphNode_MDA.h"
+#include "AnimGraphNode_SequencePlayer.h"
+#include "Animation/AnimSequence.h"
+#include "Animation/AnimData/IAnimationDataController.h"
+#include "AssetRegistry/AssetRegistryModule.h"
+#include "AssetToolsModule.h"
+
+#define LOCTEXT_NAMESPACE "MDALayerBaker"
+
+namespace MDALayerBaker
+{
+	// Sequences are baked and verified on all bones of the skeleton, from raw data so that compression doesn't show in the report
+	void InitBoneContainer(USkeleton& Skeleton, FBoneContainer& OutBoneContainer)
+	{
+		TArray<FBoneIndexType> BoneIndices;
+		const int32 NumBones = Skeleton.GetReferenceSkeleton().GetNum();
+		for (int32 BoneIndex = 0; BoneIndex < NumBones; ++BoneIndex)
+		{
+			BoneIndices.Add(static_cast<FBoneIndexType>(BoneIndex));
+		}
+
+		OutBoneContainer.InitializeTo(BoneIndices, FCurveEvaluationOption(false), Skeleton);
+		OutBoneContainer.SetUseRAWData(true);
+	}
+
+	void Sample(const UAnimSequence& Sequence, float Time, const FBoneContainer& BoneContainer, TArray<FTransform>& OutTransforms)
+	{
+		FCompactPose Pose;
+		Pose.SetBoneContainer(&BoneContainer);
+		FBlendedCurve Curve;
+		Curve.InitFrom(BoneContainer);
+		UE::Anim::FStackAttributeContainer Attributes;
+
+		FAnimationPoseData PoseData(Pose, Curve, Attributes);
+		Sequence.GetAnimationPose(PoseData, FAnimExtractContext(static_cast<double>(Time)));
+
+		OutTransforms.Reset();
+		OutTransforms.Append(Pose.GetBones());
+	}
+
+	// Accumulates the layers in order with the runtime kernels. Rotations are NOT normalized
+	void Accumulate(TArrayView<FTransform> Transforms, TArrayView<const FMDABakeLayer> Layers, float Time, const FBoneContainer& BoneContainer, const FMDARefTransforms& RefPose)
+	{
+		TArray<FTransform> Additive;
+		for (const FMDABakeLayer& Layer : Layers)
+		{
+			Sample(*Layer.Sequence, Time, BoneContainer, Additive);
+			AccumulateAdditivePoseInternal(Transforms, FMDATransformSource(Additive), RefPose, Layer.Weight, Layer.BlendMode);
+		}
+	}
+
+	// Keys of the shared timeline, at least two
+	int32 GetNumKeys(const UAnimSequence& Sequence)
+	{
+		return FMath::Max(Sequence.GetNumberOfSampledKeys(), 2);
+	}
+
+	float GetKeyTime(const UAnimSequence& Sequence, int32 Key)
+	{
+		return FMath::Min(Sequence.GetTimeAtFrame(Key), Sequence.GetPlayLength());
+	}
+
+	// Time in a sequence played by a player, for a time of the baked timeline
+	float GetSequenceTime(const UAnimSequence& Sequence, float Time, bool bLoop)
+	{
+		const float PlayLength = Sequence.GetPlayLength();
+		return bLoop && PlayLength > 0.f ? FMath::Fmod(Time, PlayLength) : FMath::Clamp(Time, 0.f, PlayLength);
+	}
+
+	// A layer of the node as it is evaluated
+	struct FVerifyLayer
+	{
+		const UAnimSequence* Sequence = nullptr;
+		float Weight = 0.f;
+		EMDABlendMode BlendMode = EMDABlendMode::Add;
+		bool bLoop = true;
+	};
+
+	// Gathers the layers of the node in order, with the run of baked layers, and with the baked sequence in its place. Layers
+	// that aren't sequence players at constant weights can't be sampled here and are left out of both
+	void GatherVerifyLayers(const UAnimGraphNode_MDA& MDANode, TArrayView<const FMDABakeLayer> Layers, const UAnimSequence& BakedSequence, TArray<FVerifyLayer>& OutLayers, TArray<FVerifyLayer>& OutReplacedLayers, int32& OutNumLeftOut)
+	{
+		const FAnimNode_MDA& Node = MDANode.Node;
+		FInputScaleBiasClamp AlphaScaleBiasClamp = Node.AlphaScaleBiasClamp;
+
+		for (int32 PoseIndex = 0; PoseIndex < Node.Poses.Num(); ++PoseIndex)
+		{
+			// the baked layer plays with the player of the first layer at weight 1, which GatherLayers checked the alpha keeps
+			if (PoseIndex == Layers[0].PoseIndex)
+			{
+				OutReplacedLayers.Add({ &BakedSequence, 1.f, EMDABlendMode::Add, Layers[0].Player->Node.IsLooping() });
+			}
+
+			if (const FMDABakeLayer* BakeLayer = Layers.FindByPredicate([PoseIndex](const FMDABakeLayer& Layer) { return Layer.PoseIndex == PoseIndex; }))
+			{
+				OutLayers.Add({ BakeLayer->Sequence, BakeLayer->Weight, BakeLayer->BlendMode, BakeLayer->Player->Node.IsLooping() });
+				continue;
+			}
+
+			const FMDALayerSettings Settings = Node.LayerSettings.IsValidIndex(PoseIndex) ? Node.LayerSettings[PoseIndex] : FMDALayerSettings();
+			const UEdGraphPin* WeightPin = MDANode.FindPin(FString::Printf(TEXT("%s_%d"), GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, BlendWeights), PoseIndex), EGPD_Input);
+			const UEdGraphPin* PosePin = MDANode.FindPin(FString::Printf(TEXT("%s_%d"), GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, Poses), PoseIndex), EGPD_Input);
+			const UAnimGraphNode_SequencePlayer* Player = Cast<UAnimGraphNode_SequencePlayer>(UAnimGraphNode_MDA::GetLinkedNode(PosePin));
+			const UAnimSequence* Sequence = Player ? Cast<UAnimSequence>(Player->GetAnimationAsset()) : nullptr;
+			if (Settings.WeightSource != EMDAWeightSource::Pin || Settings.Input != EMDALayerInput::Additive || (WeightPin && WeightPin->LinkedTo.Num() > 0)
+				|| !Sequence || !Sequence->IsValidAdditive() || Sequence->AdditiveAnimType != AAT_LocalSpaceBase)
+			{
+				++OutNumLeftOut;
+				continue;
+			}
+
+			// the node skips layers without weight
+			const float Weight = AlphaScaleBiasClamp.ApplyTo(Node.BlendWeights[PoseIndex], 0.f);
+			if (FAnimWeight::IsRelevant(Weight))
+			{
+				const FVerifyLayer Layer { Sequence, Weight, Node.BlendModes[PoseIndex], Player->Node.IsLooping() };
+				OutLayers.Add(Layer);
+				OutReplacedLayers.Add(Layer);
+			}
+		}
+	}
+
+	// Accumulates the layers onto the transforms and normalizes the rotations, as the node does
+	void EvaluateLayers(TArray<FTransform>& Transforms, TArrayView<const FVerifyLayer> Layers, float Time, const FBoneContainer& BoneContainer, TArrayView<const FTransform> RefTransforms)
+	{
+		TArray<TArray<FTransform>> Additives;
+		TArray<TArrayView<const FTransform>> LayerTransforms;
+		TArray<FMDALayerSource> SourceLayers;
+		TArray<float> SourceWeights;
+		TArray<EMDABlendMode> SourceBlendModes;
+
+		Additives.SetNum(Layers.Num());
+		SourceLayers.SetNum(Layers.Num());
+		for (int32 LayerIndex = 0; LayerIndex < Layers.Num(); ++LayerIndex)
+		{
+			const FVerifyLayer& Layer = Layers[LayerIndex];
+			Sample(*Layer.Sequence, GetSequenceTime(*Layer.Sequence, Time, Layer.bLoop), BoneContainer, Additives[LayerIndex]);
+			LayerTransforms.Add(Additives[LayerIndex]);
+			SourceWeights.Add(Layer.Weight);
+			SourceBlendModes.Add(Layer.BlendMode);
+		}
+
+		FAnimNode_MDA::AccumulateLayerTransforms(Transforms, LayerTransforms, SourceLayers, SourceWeights, SourceBlendModes, RefTransforms, false);
+	}
+}
+
+void FMDALayerBaker::GatherLayers(const UAnimGraphNode_MDA& MDANode, TArray<FMDABakeLayer>& OutLayers, TArray<FText>& OutSkipped)
+{
+	const FAnimNode_MDA& Node = MDANode.Node;
+
+	// the weight of a layer has to be the same every frame
+	if (Node.AlphaScaleBiasClamp.bInterpResult)
+	{
+		OutSkipped.Add(LOCTEXT("AlphaInterpolated", "All layers: the alpha is interpolated"));
+		return;
+	}
+
+	if (Node.ActivationMode == EMDAActivationMode::Events)
+	{
+		OutSkipped.Add(LOCTEXT("ActivatedByEvents", "All layers: layers are activated by gameplay events"));
+		return;
+	}
+
+	// the baked layer gets a weight of 1, which the alpha is applied to again at runtime
+	FInputScaleBiasClamp AlphaScaleBiasClamp = Node.AlphaScaleBiasClamp;
+	if (!FMath::IsNearlyEqual(AlphaScaleBiasClamp.ApplyTo(1.f, 0.f), 1.f))
+	{
+		OutSkipped.Add(LOCTEXT("AlphaChangesOne", "All layers: the alpha scale, bias or clamp changes a weight of 1"));
+		return;
+	}
+
+	// the run being gathered, and layers of runs that were not the longest
+	TArray<FMDABakeLayer> Run;
+	TArray<int32> DroppedPoseIndices;
+	auto EndRun = [&OutLayers, &Run, &DroppedPoseIndices]()
+	{
+		TArray<FMDABakeLayer>& Dropped = Run.Num() > OutLayers.Num() ? OutLayers : Run;
+		for (const FMDABakeLayer& Layer : Dropped)
+		{
+			DroppedPoseIndices.Add(Layer.PoseIndex);
+		}
+
+		if (Run.Num() > OutLayers.Num())
+		{
+			OutLayers = MoveTemp(Run);
+		}
+		Run.Reset();
+	};
+
+	for (int32 PoseIndex = 0; PoseIndex < Node.Poses.Num(); ++PoseIndex)
+	{
+		auto Skip = [&OutSkipped, &EndRun, PoseIndex](const FText& Reason)
+		{
+			OutSkipped.Add(FText::Format(LOCTEXT("SkippedLayer", "Layer {0}: {1}"), PoseIndex, Reason));
+			EndRun();
+		};
+
+		const FMDALayerSettings Settings = Node.LayerSettings.IsValidIndex(PoseIndex) ? Node.LayerSettings[PoseIndex] : FMDALayerSettings();
+		if (Settings.WeightSource != EMDAWeightSource::Pin)
+		{
+			Skip(LOCTEXT("WeightBound", "the weight is bound to a curve or property"));
+			continue;
+		}
+
+		if (Settings.Input != EMDALayerInput::Additive)
+		{
+			Skip(LOCTEXT("FullPoseInput", "the layer takes a full pose"));
+			continue;
+		}
+
+		const UEdGraphPin* WeightPin = MDANode.FindPin(FString::Printf(TEXT("%s_%d"), GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, BlendWeights), PoseIndex), EGPD_Input);
+		if (WeightPin && WeightPin->LinkedTo.Num() > 0)
+		{
+			Skip(LOCTEXT("WeightLinked", "the weight pin is linked"));
+			continue;
+		}
+
+		// a layer that never contributes doesn't break the run, it is only left in place
+		const float Weight = Node.BlendWeights[PoseIndex];
+		if (!FAnimWeight::IsRelevant(AlphaScaleBiasClamp.ApplyTo(Weight, 0.f)))
+		{
+			OutSkipped.Add(FText::Format(LOCTEXT("SkippedLayer", "Layer {0}: {1}"), PoseIndex, LOCTEXT("WeightZero", "the weight is zero")));
+			continue;
+		}
+
+		// the raw weight is baked, so the alpha must not change it
+		if (!FMath::IsNearlyEqual(AlphaScaleBiasClamp.ApplyTo(Weight, 0.f), Weight))
+		{
+			Skip(LOCTEXT("AlphaChangesWeight", "the alpha scale, bias or clamp changes the weight"));
+			continue;
+		}
+
+		const UEdGraphPin* PosePin = MDANode.FindPin(FString::Printf(TEXT("%s_%d"), GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, Poses), PoseIndex), EGPD_Input);
+		UAnimGraphNode_SequencePlayer* Player = Cast<UAnimGraphNode_SequencePlayer>(UAnimGraphNode_MDA::GetLinkedNode(PosePin));
+		if (!Player)
+		{
+			Skip(LOCTEXT("NotSequencePlayer", "the pose is not linked to a sequence player"));
+			continue;
+		}
+
+		const bool bPlayerInputLinked = Player->Pins.ContainsByPredicate([](const UEdGraphPin* Pin)
+		{
+			return Pin->Direction == EGPD_Input && Pin->LinkedTo.Num() > 0;
+		});
+		if (bPlayerInputLinked)
+		{
+			Skip(LOCTEXT("PlayerInputLinked", "inputs of the sequence player are linked"));
+			continue;
+		}
+
+		UAnimSequence* Sequence = Cast<UAnimSequence>(Player->GetAnimationAsset());
+		if (!Sequence || !Sequence->IsValidAdditive() || Sequence->AdditiveAnimType != AAT_LocalSpaceBase)
+		{
+			Skip(LOCTEXT("NotLocalAdditive", "the sequence is not a local space additive"));
+			continue;
+		}
+
+		if (Sequence->GetCurveData().FloatCurves.Num() > 0)
+		{
+			Skip(LOCTEXT("HasCurves", "the sequence has curves, which are not baked"));
+			continue;
+		}
+
+		// all layers of a run have to share one timeline, a layer out of sync starts another run
+		if (Run.Num() > 0)
+		{
+			const UAnimGraphNode_SequencePlayer* FirstPlayer = Run[0].Player;
+			const UAnimSequence* FirstSequence = Run[0].Sequence;
+			if (!FMath::IsNearlyEqual(Sequence->GetPlayLength(), FirstSequence->GetPlayLength())
+				|| Sequence->GetSamplingFrameRate() != FirstSequence->GetSamplingFrameRate()
+				|| Player->Node.GetPlayRate() != FirstPlayer->Node.GetPlayRate()
+				|| Player->Node.GetStartPosition() != FirstPlayer->Node.GetStartPosition()
+				|| Player->Node.IsLooping() != FirstPlayer->Node.IsLooping())
+			{
+				OutSkipped.Add(FText::Format(LOCTEXT("NotInSync", "Layer {0}: doesn't play in sync with layer {1}, so it starts another run"), PoseIndex, Run[0].PoseIndex));
+				EndRun();
+			}
+		}
+
+		FMDABakeLayer& Layer = Run.AddDefaulted_GetRef();
+		Layer.PoseIndex = PoseIndex;
+		Layer.Player = Player;
+		Layer.Sequence = Sequence;
+		Layer.Weight = Weight;
+		Layer.BlendMode = Node.BlendModes[PoseIndex];
+		Layer.Priority = Settings.Priority;
+	}
+	EndRun();
+
+	for (const int32 PoseIndex : DroppedPoseIndices)
+	{
+		OutSkipped.Add(FText::Format(LOCTEXT("ShorterRun", "Layer {0}: only the longest run of adjacent layers is baked"), PoseIndex));
+	}
+}
+
+UAnimSequence* FMDALayerBaker::Bake(USkeleton& Skeleton, TArrayView<const FMDABakeLayer> Layers)
+{
+	check(Layers.Num() > 0);
+
+	FBoneContainer BoneContainer;
+	MDALayerBaker::InitBoneContainer(Skeleton, BoneContainer);
+
+	TArray<FTransform> RefTransforms;
+	BoneContainer.FillWithCompactRefPose(RefTransforms);
+	const FMDARefTransforms RefPose(RefTransforms);
+
+	const UAnimSequence& FirstSequence = *Layers[0].Sequence;
+	const int32 NumKeys = MDALayerBaker::GetNumKeys(FirstSequence);
+	const int32 NumBones = RefTransforms.Num();
+
+	TArray<TArray<FVector3f>> Positions;
+	TArray<TArray<FQuat4f>> Rotations;
+	TArray<TArray<FVector3f>> Scales;
+	Positions.SetNum(NumBones);
+	Rotations.SetNum(NumBones);
+	Scales.SetNum(NumBones);
+
+	TArray<FTransform> Transforms;
+	for (int32 Key = 0; Key < NumKeys; ++Key)
+	{
+		// the additive of all layers
+		Transforms.Init(FTransform::Identity, NumBones);
+		MDALayerBaker::Accumulate(Transforms, Layers, MDALayerBaker::GetKeyTime(FirstSequence, Key), BoneContainer, RefPose);
+
+		// raw data of an additive sequence is the additive applied to its base, the reference pose
+		for (int32 BoneIndex = 0; BoneIndex < NumBones; ++BoneIndex)
+		{
+			const FTransform& RefTransform = RefTransforms[BoneIndex];
+			const FTransform& Additive = Transforms[BoneIndex];
+			Positions[BoneIndex].Add(FVector3f(Additive.GetTranslation() + RefTransform.GetTranslation()));
+			Rotations[BoneIndex].Add(FQuat4f((Additive.GetRotation().GetNormalized() * RefTransform.GetRotation()).GetNormalized()));
+			Scales[BoneIndex].Add(FVector3f(RefTransform.GetScale3D()));
+		}
+	}
+
+	// kept transient until the layers are replaced, so declining leaves no asset behind
+	UAnimSequence* BakedSequence = NewObject<UAnimSequence>(GetTransientPackage(), NAME_None, RF_Transactional);
+	BakedSequence->SetSkeleton(&Skeleton);
+	BakedSequence->AdditiveAnimType = AAT_LocalSpaceBase;
+	BakedSequence->RefPoseType = ABPT_RefPose;
+
+	IAnimationDataController& Controller = BakedSequence->GetController();
+	Controller.OpenBracket(LOCTEXT("BakeMDALayers", "Bake MDA Layers"), false);
+	Controller.InitializeModel();
+	Controller.SetFrameRate(FirstSequence.GetSamplingFrameRate(), false);
+	Controller.SetNumberOfFrames(FFrameNumber(NumKeys - 1), false);
+
+	const FReferenceSkeleton& RefSkeleton = Skeleton.GetReferenceSkeleton();
+	for (int32 BoneIndex = 0; BoneIndex < NumBones; ++BoneIndex)
+	{
+		const FName BoneName = RefSkeleton.GetBoneName(BoneContainer.GetSkeletonIndex(FCompactPoseBoneIndex(BoneIndex)));
+		Controller.AddBoneCurve(BoneName, false);
+		Controller.SetBoneTrackKeys(BoneName, Positions[BoneIndex], Rotations[BoneIndex], Scales[BoneIndex], false);
+	}
+
+	Controller.NotifyPopulated();
+	Controller.CloseBracket(false);
+
+	return BakedSequence;
+}
+
+void FMDALayerBaker::SaveAsAsset(UAnimSequence& BakedSequence, TArrayView<const FMDABakeLayer> Layers)
+{
+	FString PackageName;
+	FString AssetName;
+	const FAssetToolsModule& AssetToolsModule = FModuleManager::LoadModuleChecked<FAssetToolsModule>("AssetTools");
+	AssetToolsModule.Get().CreateUniqueAssetName(Layers[0].Sequence->GetOutermost()->GetName() + TEXT("_MDABaked"), FString(), PackageName, AssetName);
+
+	UPackage* Package = CreatePackage(*PackageName);
+	BakedSequence.Rename(*AssetName, Package, REN_DontCreateRedirectors);
+	BakedSequence.SetFlags(RF_Public | RF_Standalone);
+
+	BakedSequence.MarkPackageDirty();
+	FAssetRegistryModule::AssetCreated(&BakedSequence);
+}
+
+FMDABakeReport FMDALayerBaker::Verify(const UAnimGraphNode_MDA& MDANode, USkeleton& Skeleton, TArrayView<const FMDABakeLayer> Layers, const UAnimSequence& BakedSequence)
+{
+	using namespace MDALayerBaker;
+
+	FMDABakeReport Report;
+
+	FBoneContainer BoneContainer;
+	InitBoneContainer(Skeleton, BoneContainer);
+
+	TArray<FTransform> RefTransforms;
+	BoneContainer.FillWithCompactRefPose(RefTransforms);
+
+	TArray<FVerifyLayer> NodeLayers;
+	TArray<FVerifyLayer> ReplacedLayers;
+	GatherVerifyLayers(MDANode, Layers, BakedSequence, NodeLayers, ReplacedLayers, Report.NumLayersLeftOut);
+	Report.NumLayers = NodeLayers.Num();
+
+	// on the reference pose CoD Add and the order of rotations hide errors, so the base is the pose the node gets when its base
+	// pose plays a sequence, or else the reference pose with random offsets
+	const UEdGraphPin* BasePin = MDANode.FindPin(GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, BasePose), EGPD_Input);
+	const UAnimGraphNode_SequencePlayer* BasePlayer = Cast<UAnimGraphNode_SequencePlayer>(UAnimGraphNode_MDA::GetLinkedNode(BasePin));
+	const UAnimSequence* BaseSequence = BasePlayer ? Cast<UAnimSequence>(BasePlayer->GetAnimationAsset()) : nullptr;
+	if (BaseSequence && BaseSequence->IsValidAdditive())
+	{
+		BaseSequence = nullptr;
+	}
+	Report.bBaseFromGraph = BaseSequence != nullptr;
+
+	TArray<FTransform> OffsetBase = RefTransforms;
+	FRandomStream Random(0x4D4441);
+	for (FTransform& Transform : OffsetBase)
+	{
+		Transform.SetRotation((FQuat(Random.GetUnitVector(), FMath::DegreesToRadians(Random.FRandRange(5.f, 30.f))) * Transform.GetRotation()).GetNormalized());
+		Transform.AddToTranslation(Random.GetUnitVector() * Random.FRandRange(0.f, 5.f));
+	}
+
+	const UAnimSequence& FirstSequence = *Layers[0].Sequence;
+	const int32 NumKeys = GetNumKeys(FirstSequence);
+
+	TArray<FTransform> Base;
+	TArray<FTransform> Expected;
+	TArray<FTransform> Actual;
+
+	// at keys, and halfway between keys where the baked sequence interpolates the result instead of the layers
+	for (int32 Sample = 0; Sample < NumKeys * 2 - 1; ++Sample)
+	{
+		const float KeyTime = GetKeyTime(FirstSequence, Sample / 2);
+		const float Time = Sample % 2 == 0 ? KeyTime : (KeyTime + GetKeyTime(FirstSequence, Sample / 2 + 1)) * 0.5f;
+
+		if (BaseSequence)
+		{
+			MDALayerBaker::Sample(*BaseSequence, GetSequenceTime(*BaseSequence, Time, BasePlayer->Node.IsLooping()), BoneContainer, Base);
+		}
+		else
+		{
+			Base = OffsetBase;
+		}
+
+		Expected = Base;
+		EvaluateLayers(Expected, NodeLayers, Time, BoneContainer, RefTransforms);
+
+		Actual = Base;
+		EvaluateLayers(Actual, ReplacedLayers, Time, BoneContainer, RefTransforms);
+
+		for (int32 BoneIndex = 0; BoneIndex < RefTransforms.Num(); ++BoneIndex)
+		{
+			const float TranslationError = static_cast<float>(FVector::Dist(Expected[BoneIndex].GetTranslation(), Actual[BoneIndex].GetTranslation()));
+			const float RotationError = static_cast<float>(Expected[BoneIndex].GetRotation().AngularDistance(Actual[BoneIndex].GetRotation()));
+
+			if (TranslationError > Report.MaxTranslationError || RotationError > Report.MaxRotationError)
+			{
+				Report.WorstTime = Time;
+				Report.WorstBone = Skeleton.GetReferenceSkeleton().GetBoneName(BoneContainer.GetSkeletonIndex(FCompactPoseBoneIndex(BoneIndex)));
+			}
+
+			Report.MaxTranslationError = FMath::Max(Report.MaxTranslationError, TranslationError);
+			Report.MaxRotationError = FMath::Max(Report.MaxRotationError, RotationError);
+		}
+
+		++Report.NumSamples;
+	}
+
+	return Report;
+}
+
+#undef LOCTEXT_NAMESPACE
@@ -0,0 +1,226 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#include "AnimGraphNode_MDA.h"
+#include "AnimGraphNode_LocalRefPose.h"
+#include "AnimGraphNode_Root.h"
+#include "AnimGraphNode_SequencePlayer.h"
+#include "MDARuntime.h"
+#include "Animation/AnimBlueprint.h"
+#include "Animation/AnimBlueprintGeneratedClass.h"
+#include "Animation/AnimInstance.h"
+#include "Animation/AnimSequence.h"
+#include "Animation/AnimData/IAnimationDataController.h"
+#include "EdGraph/EdGraph.h"
+#include "Engine/Engine.h"
+#include "Engine/SkeletalMesh.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet2/BlueprintEditorUtils.h"
+#include "Kismet2/KismetEditorUtilities.h"
+
+#define LOCTEXT_NAMESPACE "MDANestedFixture"
+
+namespace MDANestedFixture
+{
+	// Looping additive of small random offsets from the reference pose, the first and last keys match
+	UAnimSequence* CreateAdditiveSequence(USkeleton& Skeleton, FRandomStream& Random)
+	{
+		const int32 NumKeys = 31;
+		const FReferenceSkeleton& RefSkeleton = Skeleton.GetReferenceSkeleton();
+
+		UAnimSequence* Sequence = NewObject<UAnimSequence>(GetTransientPackage());
+		Sequence->SetSkeleton(&Skeleton);
+		Sequence->AdditiveAnimType = AAT_LocalSpaceBase;
+		Sequence->RefPoseType = ABPT_RefPose;
+
+		IAnimationDataController& Controller = Sequence->GetController();
+		Controller.OpenBracket(LOCTEXT("CreateFixtureSequence", "Create MDA Fixture Sequence"), false);
+		Controller.InitializeModel();
+		Controller.SetFrameRate(FFrameRate(30, 1), false);
+		Controller.SetNumberOfFrames(FFrameNumber(NumKeys - 1), false);
+
+		TArray<FVector3f> Positions;
+		TArray<FQuat4f> Rotations;
+		TArray<FVector3f> Scales;
+		for (int32 BoneIndex = 0; BoneIndex < RefSkeleton.GetRawBoneNum(); ++BoneIndex)
+		{
+			const FTransform& RefTransform = RefSkeleton.GetRawRefBonePose()[BoneIndex];
+			const FVector Axis = Random.GetUnitVector();
+			const double MaxAngle = FMath::DegreesToRadians(Random.FRandRange(1.f, 10.f));
+			const FVector Offset = Random.GetUnitVector() * Random.FRandRange(0.f, 2.f);
+
+			// raw data of an additive sequence is the additive applied to its base, the reference pose
+			Positions.Reset();
+			Rotations.Reset();
+			Scales.Reset();
+			for (int32 Key = 0; Key < NumKeys; ++Key)
+			{
+				const double Phase = FMath::Sin(UE_DOUBLE_TWO_PI * Key / (NumKeys - 1));
+				Positions.Add(FVector3f(RefTransform.GetTranslation() + Offset * Phase));
+				Rotations.Add(FQuat4f((FQuat(Axis, MaxAngle * Phase) * RefTransform.GetRotation()).GetNormalized()));
+				Scales.Add(FVector3f(RefTransform.GetScale3D()));
+			}
+
+			const FName BoneName = RefSkeleton.GetBoneName(BoneIndex);
+			Controller.AddBoneCurve(BoneName, false);
+			Controller.SetBoneTrackKeys(BoneName, Positions, Rotations, Scales, false);
+		}
+
+		Controller.NotifyPopulated();
+		Controller.CloseBracket(false);
+
+		return Sequence;
+	}
+
+	template <typename NodeType>
+	NodeType* CreateNode(UEdGraph& Graph)
+	{
+		FGraphNodeCreator<NodeType> NodeCreator(Graph);
+		NodeType* Node = NodeCreator.CreateNode();
+		NodeCreator.Finalize();
+		return Node;
+	}
+
+	UEdGraphPin* GetOutputPin(UAnimGraphNode_Base& Node)
+	{
+		return Node.FindPin(TEXT("Pose"), EGPD_Output);
+	}
+
+	UEdGraphPin* GetLayerPin(UAnimGraphNode_MDA& MDANode, const TCHAR* PropertyName, int32 PoseIndex)
+	{
+		return MDANode.FindPin(FString::Printf(TEXT("%s_%d"), PropertyName, PoseIndex), EGPD_Input);
+	}
+
+	UEdGraphPin* CreateSequencePlayer(UEdGraph& Graph, UAnimSequence* Sequence, float PlayRate)
+	{
+		UAnimGraphNode_SequencePlayer* Player = CreateNode<UAnimGraphNode_SequencePlayer>(Graph);
+		Player->Node.SetSequence(Sequence);
+		Player->Node.SetPlayRate(PlayRate);
+		Player->ReconstructNode();
+		return GetOutputPin(*Player);
+	}
+
+	// An MDA node on the local ref pose. Layer 0 of every level but the last takes the full pose of the next level, so the
+	// evaluation of each level nests inside a layer input of the one above. The other layers play the sequences
+	UAnimGraphNode_MDA* CreateLevel(UEdGraph& Graph, TArrayView<UAnimSequence* const> Sequences, int32 Level, int32 Depth, int32 NumLayers)
+	{
+		static const EMDABlendMode BlendModes[] = { EMDABlendMode::Add, EMDABlendMode::Subtract, EMDABlendMode::CoDAdd };
+
+		UAnimGraphNode_MDA* MDANode = CreateNode<UAnimGraphNode_MDA>(Graph);
+		MDANode->Node.ResetPoses();
+		MDANode->AddPinsToBlendNode(NumLayers);
+
+		const UEdGraphSchema* Schema = Graph.GetSchema();
+		Schema->TryCreateConnection(GetOutputPin(*CreateNode<UAnimGraphNode_LocalRefPose>(Graph)), MDANode->FindPin(GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, BasePose), EGPD_Input));
+
+		for (int32 PoseIndex = 0; PoseIndex < NumLayers; ++PoseIndex)
+		{
+			UEdGraphPin* LayerOutputPin = nullptr;
+			if (PoseIndex == 0 && Level + 1 < Depth)
+			{
+				LayerOutputPin = GetOutputPin(*CreateLevel(Graph, Sequences, Level + 1, Depth, NumLayers));
+				MDANode->Node.LayerSettings[PoseIndex].Input = EMDALayerInput::FullPoseMinusReference;
+			}
+			else
+			{
+				LayerOutputPin = CreateSequencePlayer(Graph, Sequences[(Level * NumLayers + PoseIndex) % Sequences.Num()], 0.5f + 0.25f * PoseIndex);
+			}
+			Schema->TryCreateConnection(LayerOutputPin, GetLayerPin(*MDANode, GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, Poses), PoseIndex));
+
+			// the compiler reads the weights from the pin defaults
+			const float Weight = 1.f / (PoseIndex + 1);
+			MDANode->Node.BlendWeights[PoseIndex] = Weight;
+			MDANode->Node.BlendModes[PoseIndex] = BlendModes[(Level + PoseIndex) % UE_ARRAY_COUNT(BlendModes)];
+			if (UEdGraphPin* WeightPin = GetLayerPin(*MDANode, GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, BlendWeights), PoseIndex))
+			{
+				WeightPin->DefaultValue = LexToString(Weight);
+			}
+		}
+
+		return MDANode;
+	}
+
+	// A transient anim blueprint for the skeleton whose output is an MDA node fused with the levels below its base pose
+	UAnimBlueprint* CreateBlueprint(USkeleton& Skeleton, TArrayView<UAnimSequence* const> Sequences, int32 Depth, int32 NumLayers)
+	{
+		UAnimBlueprint* Blueprint = CastChecked<UAnimBlueprint>(FKismetEditorUtilities::CreateBlueprint(
+			UAnimInstance::StaticClass(), GetTransientPackage(), MakeUniqueObjectName(GetTransientPackage(), UAnimBlueprint::StaticClass(), TEXT("MDANestedFixture")),
+			BPTYPE_Normal, UAnimBlueprint::StaticClass(), UAnimBlueprintGeneratedClass::StaticClass()));
+		Blueprint->TargetSkeleton = &Skeleton;
+
+		TArray<UAnimGraphNode_Root*> Roots;
+		FBlueprintEditorUtils::GetAllNodesOfClass(Blueprint, Roots);
+		if (Roots.Num() == 0)
+		{
+			Blueprint->MarkAsGarbage();
+			return nullptr;
+		}
+
+		UEdGraph& Graph = *Roots[0]->GetGraph();
+		UAnimGraphNode_MDA* ChainNode = CreateNode<UAnimGraphNode_MDA>(Graph);
+		Graph.GetSchema()->TryCreateConnection(GetOutputPin(*CreateLevel(Graph, Sequences, 0, Depth, NumLayers)), ChainNode->FindPin(GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, BasePose), EGPD_Input));
+		Graph.GetSchema()->TryCreateConnection(CreateSequencePlayer(Graph, Sequences[0], 1.f), GetLayerPin(*ChainNode, GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, Poses), 0));
+		Graph.GetSchema()->TryCreateConnection(GetOutputPin(*ChainNode), Roots[0]->FindPin(TEXT("Result"), EGPD_Input));
+
+		FKismetEditorUtilities::CompileBlueprint(Blueprint);
+		if (Blueprint->Status == BS_Error || !Blueprint->GeneratedClass)
+		{
+			Blueprint->MarkAsGarbage();
+			return nullptr;
+		}
+
+		return Blueprint;
+	}
+}
+
+static FAutoConsoleCommand MDAStressNestedCommand(
+	TEXT("MDA.Stress.Nested"),
+	TEXT("Builds a transient anim blueprint for the mesh with MDA nodes nested Depth levels deep in layer inputs and chained on the base pose, and runs MDA.Stress on it. Args: <SkeletalMesh> [Depth] [Layers] [Instances] [Frames] [MaxScratchKB]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		using namespace MDANestedFixture;
+
+		USkeletalMesh* SkeletalMesh = Args.Num() > 0 ? LoadObject<USkeletalMesh>(nullptr, *Args[0]) : nullptr;
+		USkeleton* Skeleton = SkeletalMesh ? SkeletalMesh->GetSkeleton() : nullptr;
+		if (!Skeleton || !World)
+		{
+			UE_LOG(LogMDA, Error, TEXT("Usage: MDA.Stress.Nested <SkeletalMesh> [Depth] [Layers] [Instances] [Frames] [MaxScratchKB]"));
+			return;
+		}
+
+		const int32 Depth = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 3;
+		const int32 NumLayers = Args.Num() > 2 ? FMath::Max(FCString::Atoi(*Args[2]), 2) : 4;
+
+		// the same seed builds the same fixture, so runs can be compared
+		FRandomStream Random(0x4D4441);
+		TArray<UAnimSequence*> Sequences;
+		for (int32 Index = 0; Index < NumLayers; ++Index)
+		{
+			Sequences.Add(CreateAdditiveSequence(*Skeleton, Random));
+		}
+
+		UAnimBlueprint* Blueprint = CreateBlueprint(*Skeleton, Sequences, Depth, NumLayers);
+		if (!Blueprint)
+		{
+			UE_LOG(LogMDA, Error, TEXT("Failed to build the nested MDA fixture for %s"), *Skeleton->GetName());
+		}
+		else
+		{
+			UE_LOG(LogMDA, Log, TEXT("MDA nested fixture: %d levels of %d layers, expecting %d nested nodes"), Depth, NumLayers, Depth);
+
+			FString StressCommand = FString::Printf(TEXT("MDA.Stress %s %s"), *Blueprint->GeneratedClass->GetPathName(), *SkeletalMesh->GetPathName());
+			for (int32 Index = 3; Index < Args.Num(); ++Index)
+			{
+				StressCommand += TEXT(" ") + Args[Index];
+			}
+			GEngine->Exec(World, *StressCommand);
+
+			Blueprint->MarkAsGarbage();
+		}
+
+		for (UAnimSequence* Sequence : Sequences)
+		{
+			Sequence->MarkAsGarbage();
+		}
+	}));
+
+#undef LOCTEXT_NAMESPACE
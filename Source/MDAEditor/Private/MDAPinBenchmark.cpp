@@ -0,0 +1,149 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#include "AnimGraphNode_MDA.h"
+#include "AnimationGraphSchema.h"
+#include "MDARuntime.h"
+#include "Animation/AnimBlueprint.h"
+#include "Animation/AnimBlueprintGeneratedClass.h"
+#include "Animation/AnimInstance.h"
+#include "EdGraph/EdGraph.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet2/BlueprintEditorUtils.h"
+#include "Kismet2/KismetEditorUtilities.h"
+
+namespace MDAPinBenchmark
+{
+	FString GetPinName(const TCHAR* PropertyName, int32 PoseIndex)
+	{
+		return FString::Printf(TEXT("%s_%d"), PropertyName, PoseIndex);
+	}
+
+	// Tags each pose with its index, on the node and on the pin default values the compiler reads
+	void TagPoses(UAnimGraphNode_MDA& MDANode)
+	{
+		for (int32 PoseIndex = 0; PoseIndex < MDANode.Node.Poses.Num(); ++PoseIndex)
+		{
+			MDANode.Node.BlendWeights[PoseIndex] = static_cast<float>(PoseIndex);
+			if (UEdGraphPin* Pin = MDANode.FindPin(GetPinName(GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, BlendWeights), PoseIndex), EGPD_Input))
+			{
+				Pin->DefaultValue = LexToString(static_cast<float>(PoseIndex));
+			}
+		}
+	}
+
+	// Checks that each pose and its pins carry the tag of the expected old pose
+	bool CheckPoses(const UAnimGraphNode_MDA& MDANode, TFunctionRef<int32(int32)> GetOldIndex, int32 NumPoses)
+	{
+		if (MDANode.Node.Poses.Num() != NumPoses || MDANode.FindPin(GetPinName(GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, Poses), NumPoses), EGPD_Input))
+		{
+			return false;
+		}
+
+		for (int32 PoseIndex = 0; PoseIndex < NumPoses; ++PoseIndex)
+		{
+			const float Tag = static_cast<float>(GetOldIndex(PoseIndex));
+			const UEdGraphPin* PosePin = MDANode.FindPin(GetPinName(GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, Poses), PoseIndex), EGPD_Input);
+			const UEdGraphPin* WeightPin = MDANode.FindPin(GetPinName(GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, BlendWeights), PoseIndex), EGPD_Input);
+			if (!PosePin || !WeightPin || MDANode.Node.BlendWeights[PoseIndex] != Tag || FCString::Atof(*WeightPin->DefaultValue) != Tag)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+static FAutoConsoleCommand MDABenchPinsCommand(
+	TEXT("MDA.Bench.Pins"),
+	TEXT("Times adding, removing and reordering pins of an MDA node one by one and in batches, and checks the batched results. Args: [Layers]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		using namespace MDAPinBenchmark;
+
+		const int32 NumLayers = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 2) : 40;
+
+		// a transient anim blueprint holding one MDA node
+		UAnimBlueprint* Blueprint = CastChecked<UAnimBlueprint>(FKismetEditorUtilities::CreateBlueprint(
+			UAnimInstance::StaticClass(), GetTransientPackage(), MakeUniqueObjectName(GetTransientPackage(), UAnimBlueprint::StaticClass(), TEXT("MDAPinBenchmark")),
+			BPTYPE_Normal, UAnimBlueprint::StaticClass(), UAnimBlueprintGeneratedClass::StaticClass()));
+		UEdGraph* Graph = FBlueprintEditorUtils::CreateNewGraph(Blueprint, TEXT("MDAPinBenchmark"), UEdGraph::StaticClass(), UAnimationGraphSchema::StaticClass());
+
+		FGraphNodeCreator<UAnimGraphNode_MDA> NodeCreator(*Graph);
+		UAnimGraphNode_MDA* MDANode = NodeCreator.CreateNode();
+		NodeCreator.Finalize();
+
+		auto Time = [](TFunctionRef<void()> Func)
+		{
+			const double StartTime = FPlatformTime::Seconds();
+			Func();
+			return (FPlatformTime::Seconds() - StartTime) * 1000.0;
+		};
+
+		auto RemoveEveryOther = [](TArray<int32>& OutIndices, int32 NumPoses)
+		{
+			for (int32 PoseIndex = NumPoses - 1; PoseIndex >= 0; PoseIndex -= 2)
+			{
+				OutIndices.Add(PoseIndex);
+			}
+		};
+
+		// one by one, as the node menu does
+		MDANode->Node.ResetPoses();
+		MDANode->ReconstructNode();
+		const double SingleAddMs = Time([MDANode, NumLayers]()
+		{
+			for (int32 Index = 0; Index < NumLayers; ++Index)
+			{
+				MDANode->AddPinToBlendNode();
+			}
+		});
+
+		TArray<int32> RemovedIndices;
+		RemoveEveryOther(RemovedIndices, NumLayers);
+		const double SingleRemoveMs = Time([MDANode, &RemovedIndices]()
+		{
+			for (const int32 PoseIndex : RemovedIndices)
+			{
+				MDANode->RemovePinFromBlendNode(MDANode->FindPin(GetPinName(GET_MEMBER_NAME_STRING_CHECKED(FAnimNode_MDA, Poses), PoseIndex), EGPD_Input));
+			}
+		});
+
+		// batched
+		MDANode->Node.ResetPoses();
+		MDANode->ReconstructNode();
+		const double BatchAddMs = Time([MDANode, NumLayers]()
+		{
+			MDANode->AddPinsToBlendNode(NumLayers);
+		});
+
+		TagPoses(*MDANode);
+		const double BatchRemoveMs = Time([MDANode, &RemovedIndices]()
+		{
+			MDANode->RemovePinsFromBlendNode(RemovedIndices);
+		});
+
+		// every other pose is left, the first one removed was the last
+		const int32 NumKept = NumLayers - RemovedIndices.Num();
+		const int32 FirstKept = (NumLayers - 1) % 2 == 0 ? 1 : 0;
+		const bool bRemoveValid = CheckPoses(*MDANode, [FirstKept](int32 PoseIndex) { return FirstKept + PoseIndex * 2; }, NumKept);
+
+		TArray<int32> Reversed;
+		for (int32 PoseIndex = NumKept - 1; PoseIndex >= 0; --PoseIndex)
+		{
+			Reversed.Add(PoseIndex);
+		}
+
+		const double BatchReorderMs = Time([MDANode, &Reversed]()
+		{
+			MDANode->ReorderPinsOfBlendNode(Reversed);
+		});
+		const bool bReorderValid = CheckPoses(*MDANode, [FirstKept, NumKept](int32 PoseIndex) { return FirstKept + (NumKept - 1 - PoseIndex) * 2; }, NumKept);
+
+		UE_LOG(LogMDA, Log, TEXT("MDA pins, %d layers:"), NumLayers);
+		UE_LOG(LogMDA, Log, TEXT("  add: one by one %.2f ms, batched %.2f ms"), SingleAddMs, BatchAddMs);
+		UE_LOG(LogMDA, Log, TEXT("  remove %d: one by one %.2f ms, batched %.2f ms (%s)"), RemovedIndices.Num(), SingleRemoveMs, BatchRemoveMs, bRemoveValid ? TEXT("ok") : TEXT("FAILED"));
+		UE_LOG(LogMDA, Log, TEXT("  reverse %d: batched %.2f ms (%s)"), NumKept, BatchReorderMs, bReorderValid ? TEXT("ok") : TEXT("FAILED"));
+
+		Blueprint->MarkAsGarbage();
+	}));
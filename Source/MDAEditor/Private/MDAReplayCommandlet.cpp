@@ -0,0 +1,60 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#include "MDAReplayCommandlet.h"
+#include "MDACapture.h"
+#include "MDARuntime.h"
+
+#ifdef UE_INLINE_GENERATED_CPP_BY_NAME
+#include UE_INLINE_GENERATED_CPP_BY_NAME(MDAReplayCommandlet)
+#endif
+
+UMDAReplayCommandlet::UMDAReplayCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UMDAReplayCommandlet::Main(const FString& Params)
+{
+	FString FileName;
+	if (!FParse::Value(*Params, TEXT("File="), FileName))
+	{
+		UE_LOG(LogMDA, Error, TEXT("Usage: -run=MDAReplay -File=<Capture> [-Iterations=<N>] [-Tolerance=<Translation>] [-Quantize]"));
+		return 1;
+	}
+
+	int32 NumIterations = 100;
+	FParse::Value(*Params, TEXT("Iterations="), NumIterations);
+
+	const bool bQuantizeLayers = FParse::Param(*Params, TEXT("Quantize"));
+
+	// half precision translations of quantized layers are off by up to 1/2048 of their length
+	float Tolerance = bQuantizeLayers ? 5.e-2f : 1.e-3f;
+	FParse::Value(*Params, TEXT("Tolerance="), Tolerance);
+
+	FMDAReplayResult Result;
+	if (!FMDACapture::Replay(FileName, NumIterations, Result, bQuantizeLayers))
+	{
+		return 1;
+	}
+
+	const double SecondsPerIteration = Result.Seconds / FMath::Max(NumIterations, 1);
+	UE_LOG(LogMDA, Display, TEXT("Records: %d, Frames: %d"), Result.NumRecords, Result.NumFrames);
+	UE_LOG(LogMDA, Display, TEXT("Accumulation: %.3f ms per iteration, %.3f us per record"), SecondsPerIteration * 1000.0, SecondsPerIteration * 1000000.0 / FMath::Max(Result.NumRecords, 1));
+	UE_LOG(LogMDA, Display, TEXT("Max translation error: %f, max rotation error: %f rad"), Result.MaxTranslationError, Result.MaxRotationError);
+	if (bQuantizeLayers)
+	{
+		UE_LOG(LogMDA, Display, TEXT("Quantized layers: %d, max round trip translation error: %f, rotation error: %f deg"), Result.NumQuantizedLayers, Result.MaxQuantizationError.Translation, Result.MaxQuantizationError.RotationDegrees);
+	}
+
+	// captured transforms are stored in single precision
+	if (Result.MaxTranslationError > Tolerance)
+	{
+		UE_LOG(LogMDA, Error, TEXT("Replayed results don't match the capture"));
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,314 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#include "AnimNode_MDA.h"
+#include "MDARuntime.h"
+#include "MDAResultSharing.h"
+#include "Animation/AnimInstance.h"
+#include "Async/ParallelFor.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/SkeletalMesh.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include <atomic>
+
+namespace MDAStressTest
+{
+	// Scratch stack checks gathered from all threads of a run
+	struct FStackChecks
+	{
+		std::atomic<int32> NumUnbalanced { 0 };
+		std::atomic<int32> StackHighWater { 0 };
+		std::atomic<int32> EvaluateHighWater { 0 };
+		std::atomic<uint64> MaxAllocatedBytes { 0 };
+
+		void Check()
+		{
+			const FMDAScratchStats Stats = FAnimNode_MDA::GetThreadScratchStats();
+			if (Stats.StackDepth != 0 || Stats.EvaluateDepth != 0 || !Stats.bStacksBalanced)
+			{
+				NumUnbalanced.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			UpdateMax(StackHighWater, Stats.StackHighWater);
+			UpdateMax(EvaluateHighWater, Stats.EvaluateHighWater);
+			UpdateMax(MaxAllocatedBytes, static_cast<uint64>(Stats.AllocatedBytes));
+		}
+
+		template <typename ValueType>
+		static void UpdateMax(std::atomic<ValueType>& Max, ValueType Value)
+		{
+			ValueType Current = Max.load(std::memory_order_relaxed);
+			while (Value > Current && !Max.compare_exchange_weak(Current, Value, std::memory_order_relaxed))
+			{
+			}
+		}
+	};
+
+	struct FInstance
+	{
+		USkeletalMeshComponent* Component = nullptr;
+		FCompactPose Pose;
+		FBlendedHeapCurve Curve;
+		UE::Anim::FHeapAttributeContainer Attributes;
+		uint32 Checksum = 0;
+	};
+
+	// Components are driven by hand, so they never tick on their own
+	void CreateInstances(TArray<FInstance>& Instances, int32 NumInstances, UWorld* World, USkeletalMesh* SkeletalMesh, UClass* AnimClass)
+	{
+		Instances.SetNum(NumInstances);
+		for (FInstance& Instance : Instances)
+		{
+			Instance.Component = NewObject<USkeletalMeshComponent>(GetTransientPackage());
+			Instance.Component->SetComponentTickEnabled(false);
+			Instance.Component->VisibilityBasedAnimTickOption = EVisibilityBasedAnimTickOption::AlwaysTickPoseAndRefreshBones;
+			Instance.Component->SetSkeletalMesh(SkeletalMesh);
+			Instance.Component->SetAnimInstanceClass(AnimClass);
+			Instance.Component->RegisterComponentWithWorld(World);
+		}
+	}
+
+	void DestroyInstances(TArray<FInstance>& Instances)
+	{
+		for (FInstance& Instance : Instances)
+		{
+			Instance.Component->DestroyComponent();
+		}
+		Instances.Reset();
+	}
+
+	// Runs the worker thread part of an update and evaluates the pose
+	void EvaluateInstance(FInstance& Instance)
+	{
+		UAnimInstance* AnimInstance = Instance.Component->GetAnimInstance();
+		AnimInstance->ParallelUpdateAnimation();
+
+		FParallelEvaluationData EvaluationData = { Instance.Curve, Instance.Pose, Instance.Attributes };
+		AnimInstance->ParallelEvaluateAnimation(false, Instance.Component->GetSkeletalMeshAsset(), EvaluationData);
+	}
+
+	// Hashes the component values, since the padding lanes of vectorized transforms are undefined
+	uint32 HashPose(const FCompactPose& Pose, uint32 Crc)
+	{
+		for (const FTransform& Transform : Pose.GetBones())
+		{
+			const FQuat Rotation = Transform.GetRotation();
+			const FVector Translation = Transform.GetTranslation();
+			const FVector Scale = Transform.GetScale3D();
+			const double Components[] = { Rotation.X, Rotation.Y, Rotation.Z, Rotation.W, Translation.X, Translation.Y, Translation.Z, Scale.X, Scale.Y, Scale.Z };
+			Crc = FCrc::MemCrc32(Components, sizeof(Components), Crc);
+		}
+		return Crc;
+	}
+
+	// Loads the anim class and the skeletal mesh named by the first two arguments
+	bool LoadAssets(const TArray<FString>& Args, UClass*& OutAnimClass, USkeletalMesh*& OutSkeletalMesh)
+	{
+		OutAnimClass = LoadObject<UClass>(nullptr, *Args[0]);
+		OutSkeletalMesh = LoadObject<USkeletalMesh>(nullptr, *Args[1]);
+		if (!OutAnimClass || !OutAnimClass->IsChildOf<UAnimInstance>() || !OutSkeletalMesh)
+		{
+			UE_LOG(LogMDA, Error, TEXT("Failed to load the anim class %s or the skeletal mesh %s"), *Args[0], *Args[1]);
+			return false;
+		}
+		return true;
+	}
+
+	// Runs the instances from their initial state for the frames, evaluating them in NumTasks tasks. Returns the seconds taken
+	double Run(TArray<FInstance>& Instances, int32 NumFrames, int32 NumTasks, FStackChecks& Checks)
+	{
+		for (FInstance& Instance : Instances)
+		{
+			Instance.Component->InitAnim(true);
+			Instance.Checksum = 0;
+		}
+
+		const float DeltaTime = 1.f / 30.f;
+		const int32 InstancesPerTask = FMath::DivideAndRoundUp(Instances.Num(), NumTasks);
+
+		const double StartTime = FPlatformTime::Seconds();
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			// nodes sharing results must not copy outputs of the previous simulated frame
+			FMDAResultSharing::BeginFrame();
+
+			for (FInstance& Instance : Instances)
+			{
+				Instance.Component->GetAnimInstance()->UpdateAnimation(DeltaTime, false, UAnimInstance::EUpdateAnimationFlag::ForceParallelUpdate);
+			}
+
+			ParallelFor(NumTasks, [&Instances, &Checks, InstancesPerTask](int32 TaskIndex)
+			{
+				const int32 End = FMath::Min((TaskIndex + 1) * InstancesPerTask, Instances.Num());
+				for (int32 Index = TaskIndex * InstancesPerTask; Index < End; ++Index)
+				{
+					FInstance& Instance = Instances[Index];
+					EvaluateInstance(Instance);
+
+					// every evaluation has to leave the stacks of its thread empty
+					Checks.Check();
+
+					Instance.Checksum = HashPose(Instance.Pose, Instance.Checksum);
+				}
+			}, NumTasks == 1 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::Unbalanced);
+
+			for (FInstance& Instance : Instances)
+			{
+				Instance.Component->GetAnimInstance()->PostUpdateAnimation();
+			}
+		}
+
+		return FPlatformTime::Seconds() - StartTime;
+	}
+}
+
+static FAutoConsoleCommand MDAStressCommand(
+	TEXT("MDA.Stress"),
+	TEXT("Evaluates many instances of an anim blueprint across task graph workers, checking the MDA scratch stacks and comparing with a single threaded run. Args: <AnimClass> <SkeletalMesh> [Instances] [Frames] [MaxScratchKB]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		using namespace MDAStressTest;
+
+		if (Args.Num() < 2 || !World)
+		{
+			UE_LOG(LogMDA, Error, TEXT("Usage: MDA.Stress <AnimClass> <SkeletalMesh> [Instances] [Frames] [MaxScratchKB]"));
+			return;
+		}
+
+		UClass* AnimClass = nullptr;
+		USkeletalMesh* SkeletalMesh = nullptr;
+		if (!LoadAssets(Args, AnimClass, SkeletalMesh))
+		{
+			return;
+		}
+
+		const int32 NumInstances = Args.Num() > 2 ? FMath::Max(FCString::Atoi(*Args[2]), 1) : 256;
+		const int32 NumFrames = Args.Num() > 3 ? FMath::Max(FCString::Atoi(*Args[3]), 1) : 2000;
+		const uint64 MaxScratchBytes = (Args.Num() > 4 ? FMath::Max(FCString::Atoi(*Args[4]), 1) : 1024) * 1024ull;
+
+		TArray<FInstance> Instances;
+		CreateInstances(Instances, NumInstances, World, SkeletalMesh, AnimClass);
+
+		// the reference
+		FStackChecks Checks;
+		const double SingleThreadSeconds = Run(Instances, NumFrames, 1, Checks);
+
+		TArray<uint32> ReferenceChecksums;
+		for (const FInstance& Instance : Instances)
+		{
+			ReferenceChecksums.Add(Instance.Checksum);
+		}
+
+		UE_LOG(LogMDA, Log, TEXT("MDA stress: %d instances of %s, %d frames, %d worker threads"), NumInstances, *AnimClass->GetName(), NumFrames, FTaskGraphInterface::Get().GetNumWorkerThreads());
+		UE_LOG(LogMDA, Log, TEXT("   1 task : %8.1f instance frames/s"), NumInstances * NumFrames / SingleThreadSeconds);
+
+		// scale the number of tasks up to every worker and the game thread
+		int32 NumMismatches = 0;
+		const int32 MaxTasks = FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+		for (int32 NumTasks = 2; NumTasks <= MaxTasks; NumTasks = NumTasks < MaxTasks ? FMath::Min(NumTasks * 2, MaxTasks) : NumTasks + 1)
+		{
+			const double Seconds = Run(Instances, NumFrames, NumTasks, Checks);
+
+			int32 NumRunMismatches = 0;
+			for (int32 Index = 0; Index < NumInstances; ++Index)
+			{
+				NumRunMismatches += Instances[Index].Checksum != ReferenceChecksums[Index] ? 1 : 0;
+			}
+			NumMismatches += NumRunMismatches;
+
+			UE_LOG(LogMDA, Log, TEXT("  %2d tasks: %8.1f instance frames/s, %.2fx, %d instances differ from the single threaded run"),
+				NumTasks, NumInstances * NumFrames / Seconds, SingleThreadSeconds / Seconds, NumRunMismatches);
+		}
+
+		const uint64 MaxAllocatedBytes = Checks.MaxAllocatedBytes.load();
+		UE_LOG(LogMDA, Log, TEXT("Stacks: %d unbalanced evaluations, high water %d layers, %d nested nodes, %llu bytes of scratch (limit %llu)"),
+			Checks.NumUnbalanced.load(), Checks.StackHighWater.load(), Checks.EvaluateHighWater.load(), MaxAllocatedBytes, MaxScratchBytes);
+
+		const bool bPassed = Checks.NumUnbalanced.load() == 0 && NumMismatches == 0 && MaxAllocatedBytes <= MaxScratchBytes;
+		UE_LOG(LogMDA, Log, TEXT("MDA stress %s"), bPassed ? TEXT("passed") : TEXT("FAILED"));
+
+		DestroyInstances(Instances);
+	}));
+
+static FAutoConsoleCommand MDASharingTestCommand(
+	TEXT("MDA.Sharing.Test"),
+	TEXT("Ticks two instances of an anim blueprint with result sharing from the same start time at different rates, and checks that sharing doesn't change their poses. Args: <AnimClass> <SkeletalMesh> [Frames]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		using namespace MDAStressTest;
+
+		IConsoleVariable* SharingEnable = IConsoleManager::Get().FindConsoleVariable(TEXT("a.MDA.Sharing.Enable"));
+		if (Args.Num() < 2 || !World || !SharingEnable)
+		{
+			UE_LOG(LogMDA, Error, TEXT("Usage: MDA.Sharing.Test <AnimClass> <SkeletalMesh> [Frames]"));
+			return;
+		}
+
+		UClass* AnimClass = nullptr;
+		USkeletalMesh* SkeletalMesh = nullptr;
+		if (!LoadAssets(Args, AnimClass, SkeletalMesh))
+		{
+			return;
+		}
+
+		const int32 NumFrames = Args.Num() > 2 ? FMath::Max(FCString::Atoi(*Args[2]), 1) : 300;
+		const float DeltaTime = 1.f / 60.f;
+		const bool bWasSharingEnabled = SharingEnable->GetBool();
+
+		TArray<FInstance> Instances;
+		CreateInstances(Instances, 2, World, SkeletalMesh, AnimClass);
+
+		// the second instance ticks twice as fast, both start at 0
+		auto Run = [&Instances, NumFrames, DeltaTime, SharingEnable](bool bShare, TArray<uint32>& OutChecksums)
+		{
+			SharingEnable->Set(bShare, ECVF_SetByConsole);
+			OutChecksums.Reset();
+
+			for (FInstance& Instance : Instances)
+			{
+				Instance.Component->InitAnim(true);
+			}
+
+			for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+			{
+				for (int32 Index = 0; Index < Instances.Num(); ++Index)
+				{
+					Instances[Index].Component->GetAnimInstance()->UpdateAnimation(DeltaTime * (Index + 1), false, UAnimInstance::EUpdateAnimationFlag::ForceParallelUpdate);
+				}
+
+				for (FInstance& Instance : Instances)
+				{
+					EvaluateInstance(Instance);
+					OutChecksums.Add(HashPose(Instance.Pose, 0));
+				}
+
+				for (FInstance& Instance : Instances)
+				{
+					Instance.Component->GetAnimInstance()->PostUpdateAnimation();
+				}
+
+				// results are shared within a frame, the simulated frames must not see each other's
+				FMDAResultSharing::BeginFrame();
+			}
+		};
+
+		TArray<uint32> SharedChecksums;
+		TArray<uint32> ReferenceChecksums;
+		FMDAResultSharing::LogStats(true);
+		Run(true, SharedChecksums);
+		FMDAResultSharing::LogStats(true);
+		Run(false, ReferenceChecksums);
+		SharingEnable->Set(bWasSharingEnabled, ECVF_SetByConsole);
+
+		int32 NumMismatches = 0;
+		for (int32 Index = 0; Index < SharedChecksums.Num(); ++Index)
+		{
+			NumMismatches += SharedChecksums[Index] != ReferenceChecksums[Index] ? 1 : 0;
+		}
+
+		UE_LOG(LogMDA, Log, TEXT("MDA sharing test %s: %d of %d evaluations differ from the evaluations without sharing"),
+			NumMismatches == 0 ? TEXT("passed") : TEXT("FAILED"), NumMismatches, SharedChecksums.Num());
+
+		DestroyInstances(Instances);
+	}));
@@ -10,6 +10,9 @@
 #include "SlotBase.h"
 #include "Types/SlateEnums.h"
 #include "Widgets/SBoxPanel.h"
+#include "Widgets/Text/STextBlock.h"
+#include "Animation/AnimBlueprint.h"
+#include "Animation/AnimInstance.h"
 
 class SWidget;
 
@@ -52,3 +55,93 @@ FReply SGraphNodeMDA::OnAddPin()
 
 	return FReply::Handled();
 }
+
+void SGraphNodeMDA::CreateBelowPinControls(TSharedPtr<SVerticalBox> MainBox)
+{
+	SAnimationGraphNode::CreateBelowPinControls(MainBox);
+
+	// one row per layer, shown while an instance is debugged
+	TSharedRef<SVerticalBox> LayerBox = SNew(SVerticalBox)
+		.Visibility(this, &SGraphNodeMDA::GetLayerDebugVisibility);
+
+	for (int32 PoseIndex = 0; PoseIndex < Node->Node.Poses.Num(); ++PoseIndex)
+	{
+		LayerBox->AddSlot()
+			.AutoHeight()
+			.Padding(FMargin(8.0f, 1.0f))
+			[
+				SNew(STextBlock)
+				.Text(this, &SGraphNodeMDA::GetLayerDebugText, PoseIndex)
+				.ColorAndOpacity(this, &SGraphNodeMDA::GetLayerDebugColor, PoseIndex)
+			];
+	}
+
+	MainBox->AddSlot()
+		.AutoHeight()
+		.Padding(Settings->GetInputPinPadding())
+		[
+			LayerBox
+		];
+}
+
+const FAnimNode_MDA* SGraphNodeMDA::GetDebuggedNode() const
+{
+	const UAnimBlueprint* AnimBlueprint = Node->GetAnimBlueprint();
+	UAnimInstance* AnimInstance = AnimBlueprint ? Cast<UAnimInstance>(AnimBlueprint->GetObjectBeingDebugged()) : nullptr;
+	return AnimInstance ? Node->GetActiveInstanceNode<FAnimNode_MDA>(AnimInstance) : nullptr;
+}
+
+EVisibility SGraphNodeMDA::GetLayerDebugVisibility() const
+{
+	return GetDebuggedNode() ? EVisibility::Visible : EVisibility::Collapsed;
+}
+
+FText SGraphNodeMDA::GetLayerDebugText(int32 PoseIndex) const
+{
+	const FAnimNode_MDA* DebuggedNode = GetDebuggedNode();
+	if (!DebuggedNode)
+	{
+		return FText::GetEmpty();
+	}
+
+	FNumberFormattingOptions AlphaFormat;
+	AlphaFormat.SetMinimumFractionalDigits(2).SetMaximumFractionalDigits(2);
+
+	const FText Alpha = FText::AsNumber(DebuggedNode->GetLayerActualAlpha(PoseIndex), &AlphaFormat);
+	const FMDALayerDebugStats* Stats = DebuggedNode->GetLayerDebugStats(PoseIndex);
+	if (!Stats)
+	{
+		return FText::Format(NSLOCTEXT("MDANode", "MDANodeLayerDebugAlpha", "Pose {0}: {1}"), PoseIndex, Alpha);
+	}
+
+	FNumberFormattingOptions TimeFormat;
+	TimeFormat.SetMaximumFractionalDigits(1);
+
+	// the editor draws after the anim instance has evaluated this frame
+	const bool bEvaluated = Stats->LastEvaluatedFrame + 1 >= GFrameCounter;
+	return FText::Format(NSLOCTEXT("MDANode", "MDANodeLayerDebug", "Pose {0}: {1}  {2}  {3} us"),
+		PoseIndex,
+		Alpha,
+		bEvaluated ? NSLOCTEXT("MDANode", "MDANodeLayerEvaluated", "evaluated") : NSLOCTEXT("MDANode", "MDANodeLayerSkipped", "skipped"),
+		FText::AsNumber(Stats->AverageMicroseconds, &TimeFormat));
+}
+
+FSlateColor SGraphNodeMDA::GetLayerDebugColor(int32 PoseIndex) const
+{
+	const FAnimNode_MDA* DebuggedNode = GetDebuggedNode();
+	const FMDALayerDebugStats* Stats = DebuggedNode ? DebuggedNode->GetLayerDebugStats(PoseIndex) : nullptr;
+	const bool bEvaluated = Stats ? Stats->LastEvaluatedFrame + 1 >= GFrameCounter : DebuggedNode && DebuggedNode->GetLayerActualAlpha(PoseIndex) > ZERO_ANIMWEIGHT_THRESH;
+
+	if (!bEvaluated)
+	{
+		return FSlateColor::UseSubduedForeground();
+	}
+
+	// evaluated at a weight that hardly shows
+	if (DebuggedNode->GetLayerActualAlpha(PoseIndex) < 0.05f)
+	{
+		return FLinearColor(1.0f, 0.6f, 0.1f);
+	}
+
+	return FSlateColor::UseForeground();
+}
@@ -7,6 +7,8 @@
 #include "AnimGraphNode_MDA.generated.h"
 
 class SGraphNodeMDA;
+class UAnimSequence;
+struct FMDABakeLayer;
 
 UCLASS(meta = (Keywords = "MDA"))
 class MDAEDITOR_API UAnimGraphNode_MDA : public UAnimGraphNode_Base
@@ -20,6 +22,18 @@ class MDAEDITOR_API UAnimGraphNode_MDA : public UAnimGraphNode_Base
 	//@TODO: Generalize this behavior (returning a list of actions/delegates maybe?)
 	virtual void AddPinToBlendNode();
 	virtual void RemovePinFromBlendNode(UEdGraphPin* Pin);
+
+	// Batched pin edits, each in one transaction and one reconstruction
+	void AddPinsToBlendNode(int32 Count);
+	void RemovePinsFromBlendNode(TArrayView<const int32> PoseIndices);
+	// NewOrder holds the old index of each pose in the new order
+	void ReorderPinsOfBlendNode(TArrayView<const int32> NewOrder);
+
+	// Bakes the sequence layers playing in sync at constant weights into one additive sequence, and replaces them after confirmation
+	void BakeStaticLayers();
+
+	// Gets the node linked to an input pin through reroute nodes
+	static UEdGraphNode* GetLinkedNode(const UEdGraphPin* InputPin);
 	virtual void ReallocatePinsDuringReconstruction(TArray<UEdGraphPin*>& OldPins) override;
 
 	//~ Begin UEdGraphNode Interface.
@@ -33,15 +47,29 @@ class MDAEDITOR_API UAnimGraphNode_MDA : public UAnimGraphNode_Base
 
 	//~ Begin UAnimGraphNode_Base Interface
 	virtual FString GetNodeCategory() const override;
+	virtual void OnProcessDuringCompilation(IAnimBlueprintCompilationContext& InCompilationContext, IAnimBlueprintGeneratedClassCompiledData& OutCompiledData) override;
+	virtual void CopyNodeDataToPreviewNode(FAnimNode_Base* InPreviewNode) override;
+	virtual void CustomizePinData(UEdGraphPin* Pin, FName SourcePropertyName, int32 ArrayIndex) const override;
 	//~ End UAnimGraphNode_Base Interface
 
+	//~ Begin UObject Interface
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+	//~ End UObject Interface
+
 	// UK2Node interface
 	virtual void GetNodeContextMenuActions(UToolMenu* Menu, UGraphNodeContextMenuContext* Context) const override;
 	// End of UK2Node interface
 
 private:
-	int32 RemovedPinArrayIndex;
+	// new index of each old pin index while pins are remapped, INDEX_NONE for removed pins
+	TArray<int32> PinRemap;
+
+	// remaps the poses and their pins in one reconstruction. NewOrder holds the old index of each new pose
+	void RemapPins(TArrayView<const int32> NewOrder);
+
+	// removes removed pins and adjusts array indices of remained pins by the pin remap
+	void RemapOldPins(TArray<UEdGraphPin*>& OldPins) const;
 
-	// removes removed pins and adjusts array indices of remained pins
-	void RemovePinsFromOldPins(TArray<UEdGraphPin*>& OldPins, int32 RemovedArrayIndex);
+	// replaces baked layers with one layer playing the baked sequence
+	void ReplaceBakedLayers(TArrayView<const FMDABakeLayer> Layers, UAnimSequence* BakedSequence);
 };
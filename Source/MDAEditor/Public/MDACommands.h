@@ -24,4 +24,7 @@ public:
 	// Blend list options
 	TSharedPtr< FUICommandInfo > AddBlendListPin;
 	TSharedPtr< FUICommandInfo > RemoveBlendListPin;
+
+	// Baking
+	TSharedPtr< FUICommandInfo > BakeStaticLayers;
 };
\ No newline at end of file
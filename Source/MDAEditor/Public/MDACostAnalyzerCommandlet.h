@@ -0,0 +1,25 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MDACostAnalyzerCommandlet.generated.h"
+
+/**
+ * Scans anim blueprints for MDA nodes and reports their layers and estimated cost, sorted by cost
+ * Usage: -run=MDACostAnalyzer [-Path=/Game] [-Out=<File.csv|File.json>] [-NsPerBoneLayer=<ns>] [-NsPerLayer=<ns>] [-NsPerCurveLayer=<ns>]
+ * The cost constants default to rough single thread numbers, MDA.Bench.ParallelAccumulate measures them on the target hardware
+ */
+UCLASS()
+class UMDACostAnalyzerCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UMDACostAnalyzerCommandlet();
+
+	//~ Begin UCommandlet Interface
+	virtual int32 Main(const FString& Params) override;
+	//~ End UCommandlet Interface
+};
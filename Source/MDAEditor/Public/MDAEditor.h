@@ -55,6 +55,8 @@ public:
 	// Remove
 	void OnRemovePosePin();
 	bool CanRemovePosePin() const { return true;};
+	// Bake
+	void OnBakeStaticLayers();
 	
 	void TestCommand();
 
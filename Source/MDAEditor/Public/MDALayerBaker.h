@@ -0,0 +1,67 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AnimNode_MDA.h"
+
+class UAnimGraphNode_MDA;
+class UAnimGraphNode_SequencePlayer;
+class UAnimSequence;
+class USkeleton;
+
+// A layer of an MDA node that plays a sequence at a constant weight
+struct FMDABakeLayer
+{
+	int32 PoseIndex = INDEX_NONE;
+	UAnimGraphNode_SequencePlayer* Player = nullptr;
+	UAnimSequence* Sequence = nullptr;
+	float Weight = 0.f;
+	EMDABlendMode BlendMode = EMDABlendMode::Add;
+	uint8 Priority = 128;
+};
+
+// Comparison of a node evaluated with its layers and with the baked layer in their place
+struct FMDABakeReport
+{
+	int32 NumSamples = 0;
+
+	// Layers of the node evaluated in the comparison, and layers left out as they can't be sampled without running the graph
+	int32 NumLayers = 0;
+	int32 NumLayersLeftOut = 0;
+
+	// Whether the base is the sequence played by the base pose, or the reference pose with random offsets
+	bool bBaseFromGraph = false;
+
+	float MaxTranslationError = 0.f;
+	float MaxRotationError = 0.f;
+	float WorstTime = 0.f;
+	FName WorstBone;
+};
+
+/**
+ * Flattens the sequence layers of an MDA node that play in sync at constant weights into one additive sequence.
+ * Each key of the baked sequence is the accumulation of the layers by the runtime kernels onto an identity pose,
+ * so the baked layer applied with Add at weight 1 gives the same pose at keys.
+ */
+class FMDALayerBaker
+{
+public:
+	/**
+	 * Gathers the longest run of adjacent layers of the node that can be baked together. Additive rotations don't commute,
+	 * so a layer that can't be baked ends a run. Reasons for the other layers are added to OutSkipped
+	 */
+	static void GatherLayers(const UAnimGraphNode_MDA& MDANode, TArray<FMDABakeLayer>& OutLayers, TArray<FText>& OutSkipped);
+
+	/** Writes the accumulated layers to a new transient additive sequence */
+	static UAnimSequence* Bake(USkeleton& Skeleton, TArrayView<const FMDABakeLayer> Layers);
+
+	/** Moves a baked sequence to a new asset next to the first layer's sequence */
+	static void SaveAsAsset(UAnimSequence& BakedSequence, TArrayView<const FMDABakeLayer> Layers);
+
+	/**
+	 * Evaluates the layers of the node through its accumulation, once as they are and once with the baked sequence in place of
+	 * the run, on a base other than the reference pose, and compares both at keys and between keys
+	 */
+	static FMDABakeReport Verify(const UAnimGraphNode_MDA& MDANode, USkeleton& Skeleton, TArrayView<const FMDABakeLayer> Layers, const UAnimSequence& BakedSequence);
+};
@@ -0,0 +1,24 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MDAReplayCommandlet.generated.h"
+
+/**
+ * Replays a MDA capture headless for benchmarking and checking results
+ * Usage: -run=MDAReplay -File=<Capture> [-Iterations=<N>] [-Tolerance=<Translation>]
+ */
+UCLASS()
+class UMDAReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UMDAReplayCommandlet();
+
+	//~ Begin UCommandlet Interface
+	virtual int32 Main(const FString& Params) override;
+	//~ End UCommandlet Interface
+};
@@ -25,5 +25,15 @@ protected:
 	// SGraphNode interface
 	virtual void CreateInputSideAddButton(TSharedPtr<SVerticalBox> InputBox) override;
 	virtual FReply OnAddPin() override;
+	virtual void CreateBelowPinControls(TSharedPtr<SVerticalBox> MainBox) override;
 	// End of SGraphNode interface
+
+private:
+	// The node instance of the anim instance being debugged
+	const FAnimNode_MDA* GetDebuggedNode() const;
+
+	// Per layer weight, evaluation and cost rows while debugging
+	EVisibility GetLayerDebugVisibility() const;
+	FText GetLayerDebugText(int32 PoseIndex) const;
+	FSlateColor GetLayerDebugColor(int32 PoseIndex) const;
 };
@@ -1,7 +1,21 @@
 // Copyright 2023 dest1yo. All Rights Reserved.
 
 #include "AnimNode_MDA.h"
+#include "MDARuntime.h"
+#include "MDALayerSet.h"
+#include "MDACapture.h"
+#include "MDABudgetSubsystem.h"
+#include "MDAResultSharing.h"
 #include "AnimationRuntime.h"
+#include "Algo/BinarySearch.h"
+#include "Animation/AnimClassInterface.h"
+#include "Animation/AnimInstance.h"
+#include "Animation/AnimInstanceProxy.h"
+#include "Animation/AnimNode_SequencePlayer.h"
+#include "Animation/AnimSequenceBase.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectIterator.h"
 
 #ifdef UE_INLINE_GENERATED_CPP_BY_NAME
 #include UE_INLINE_GENERATED_CPP_BY_NAME(AnimNode_MDA)
@@ -14,99 +28,979 @@ struct FMDAData : public TThreadSingleton<FMDAData>
 	TArray<EMDABlendMode, TInlineAllocator<8>> SourceBlendModes;
 	TArray<FBlendedCurve, TInlineAllocator<8>> SourceCurves;
 	TArray<UE::Anim::FStackAttributeContainer, TInlineAllocator<8>> SourceAttributes;
+	TArray<FMDALayerSource, TInlineAllocator<8>> SourceLayers;
+
+	// Number of MDA evaluations in flight
+	int32 EvaluateDepth = 0;
+
+	// An evaluation is measured for the budget, nested ones are part of its cost
+	bool bMeasuringCost = false;
+
+	// Cycles spent evaluating base poses of the measured evaluation, which aren't MDA cost
+	uint64 BasePoseCycles = 0;
+
+	// Largest stack and evaluation depths reached on this thread
+	int32 StackHighWater = 0;
+	int32 EvaluateHighWater = 0;
+
+	// Largest scratch memory reached on this thread. Pushed poses and curves free their storage when popped, so it is sampled at the top of the stacks
+	SIZE_T AllocatedHighWater = 0;
+
+	// Scratch memory in use, including the bones and curves of the pushed poses
+	SIZE_T GetAllocatedSize() const
+	{
+		SIZE_T Size = SourcePoses.GetAllocatedSize()
+			+ SourceWeights.GetAllocatedSize()
+			+ SourceBlendModes.GetAllocatedSize()
+			+ SourceCurves.GetAllocatedSize()
+			+ SourceAttributes.GetAllocatedSize()
+			+ SourceLayers.GetAllocatedSize();
+
+		for (const FCompactPose& Pose : SourcePoses)
+		{
+			Size += Pose.GetBones().GetAllocatedSize();
+		}
+
+		for (const FBlendedCurve& Curve : SourceCurves)
+		{
+			Size += Curve.Elements.GetAllocatedSize();
+		}
+
+		return Size;
+	}
 };
 
-/////////////////////////////////////////////////////
-// FAnimNode_MDA
+static TAutoConsoleVariable<int32> CVarMDAParallelBoneThreshold(
+	TEXT("a.MDA.ParallelBoneThreshold"),
+	512,
+	TEXT("Minimum number of bones for nodes allowing parallel bone accumulation to split the pose into chunks. See MDA.Bench.ParallelAccumulate"));
+
+static TAutoConsoleVariable<int32> CVarMDAParallelBoneChunkSize(
+	TEXT("a.MDA.ParallelBoneChunkSize"),
+	128,
+	TEXT("Number of bones accumulated by one parallel task, rounded up to a multiple of 16"));
+
+namespace MDAParallel
+{
+	// 16 transforms span a whole number of cache lines in both float and double builds. FAnimStackAllocator doesn't align
+	// the bone array to a cache line though, so neighbouring chunks may still share the one line at their boundary
+	constexpr int32 ChunkAlignment = 16;
+
+	int32 GetChunkSize()
+	{
+		return Align(FMath::Max(CVarMDAParallelBoneChunkSize.GetValueOnAnyThread(), 1), ChunkAlignment);
+	}
+
+	// Accumulates every layer and normalizes the rotations of the bones [BoneBegin, BoneEnd)
+	template <typename RefType>
+	void AccumulateBoneRange(TArrayView<FTransform> OutTransforms, TArrayView<const TArrayView<const FTransform>> LayerTransforms, TArrayView<const FMDALayerSource> SourceLayers, TArrayView<const float> SourceWeights, TArrayView<const EMDABlendMode> SourceBlendModes, const RefType& RefPose, int32 BoneBegin, int32 BoneEnd)
+	{
+		for (int32 LayerIndex = 0; LayerIndex < LayerTransforms.Num(); ++LayerIndex)
+		{
+			const float Weight = SourceWeights[LayerIndex];
+			const EMDABlendMode BlendMode = SourceBlendModes[LayerIndex];
+
+			VisitAdditiveSource(LayerTransforms[LayerIndex], SourceLayers[LayerIndex], [OutTransforms, &RefPose, Weight, BlendMode, BoneBegin, BoneEnd](const auto& AdditiveSource)
+			{
+				AccumulateAdditivePoseInternal(OutTransforms, AdditiveSource, RefPose, Weight, BlendMode, BoneBegin, BoneEnd);
+			});
+		}
+
+		for (int32 BoneIndex = BoneBegin; BoneIndex < BoneEnd; ++BoneIndex)
+		{
+			OutTransforms[BoneIndex].NormalizeRotation();
+		}
+	}
+
+	// Accumulates every layer, on chunks of bones in parallel if asked
+	template <typename RefType>
+	void AccumulateLayers(TArrayView<FTransform> OutTransforms, TArrayView<const TArrayView<const FTransform>> LayerTransforms, TArrayView<const FMDALayerSource> SourceLayers, TArrayView<const float> SourceWeights, TArrayView<const EMDABlendMode> SourceBlendModes, const RefType& RefPose, bool bParallel)
+	{
+		const int32 NumBones = OutTransforms.Num();
+		const int32 ChunkSize = GetChunkSize();
+		const int32 NumChunks = bParallel ? FMath::DivideAndRoundUp(NumBones, ChunkSize) : 1;
+
+		if (NumChunks <= 1)
+		{
+			AccumulateBoneRange(OutTransforms, LayerTransforms, SourceLayers, SourceWeights, SourceBlendModes, RefPose, 0, NumBones);
+			return;
+		}
+
+		// While it waits for the chunks, this thread may run other tasks, including MDA evaluations that grow its scratch stacks
+		// and move the per layer arrays. The chunks read copies of them. The bone buffers belong to the poses and don't move
+		const TArray<TArrayView<const FTransform>, TInlineAllocator<8>> ChunkLayerTransforms(LayerTransforms.GetData(), LayerTransforms.Num());
+		const TArray<FMDALayerSource, TInlineAllocator<8>> ChunkSourceLayers(SourceLayers.GetData(), SourceLayers.Num());
+		const TArray<float, TInlineAllocator<8>> ChunkSourceWeights(SourceWeights.GetData(), SourceWeights.Num());
+		const TArray<EMDABlendMode, TInlineAllocator<8>> ChunkSourceBlendModes(SourceBlendModes.GetData(), SourceBlendModes.Num());
+
+		// each bone is only read and written by its own chunk, across all layers
+		ParallelFor(NumChunks, [&](int32 ChunkIndex)
+		{
+			const int32 BoneBegin = ChunkIndex * ChunkSize;
+			const int32 BoneEnd = FMath::Min(BoneBegin + ChunkSize, NumBones);
+			AccumulateBoneRange(OutTransforms, ChunkLayerTransforms, ChunkSourceLayers, ChunkSourceWeights, ChunkSourceBlendModes, RefPose, BoneBegin, BoneEnd);
+		});
+	}
+}
+
+/////////////////////////////////////////////////////
+// FAnimNode_MDA
+
+void FAnimNode_MDA::Initialize_AnyThread(const FAnimationInitializeContext& Context)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_ANIMNODE(Initialize_AnyThread)
+	FAnimNode_Base::Initialize_AnyThread(Context);
+
+	// this should be consistent all the time by editor node
+	if (!ensure(Poses.Num() == BlendWeights.Num()))
+	{
+		BlendWeights.Init(0.f, Poses.Num());
+	}
+
+	if (!ensure(Poses.Num() == BlendModes.Num()))
+	{
+		BlendModes.Init(EMDABlendMode::Add, Poses.Num());
+	}
+
+	// nodes saved before layer settings existed have none
+	if (LayerSettings.Num() != Poses.Num())
+	{
+		LayerSettings.SetNum(Poses.Num());
+	}
+	AlphaScaleBiasClamp.Reinitialize();
+
+	InitializeLayerStates(Context);
+	CachedBonesSerialNumber = 0;
+
+	// layers requested on stay on at their target, as their commands are already consumed. Layers blending out end there.
+	// The queue outlives reinitialization so that commands sent meanwhile aren't lost
+	int32 NumActiveLayers = 0;
+	for (const FMDAActiveLayer& ActiveLayer : ActiveLayers)
+	{
+		if (ActivationMode == EMDAActivationMode::Events && ActiveLayer.TargetAlpha > 0.f && LayerStates.IsValidIndex(ActiveLayer.PoseIndex) && !LayerSettings[ActiveLayer.PoseIndex].LayerName.IsNone())
+		{
+			FMDAActiveLayer& KeptLayer = ActiveLayers[NumActiveLayers++];
+			KeptLayer = ActiveLayer;
+			KeptLayer.Alpha = KeptLayer.TargetAlpha;
+		}
+	}
+	ActiveLayers.SetNum(NumActiveLayers, false);
+
+	NamedLayers.Reset();
+	if (ActivationMode == EMDAActivationMode::Events)
+	{
+		for (int32 PoseIndex = 0; PoseIndex < LayerSettings.Num(); ++PoseIndex)
+		{
+			if (!LayerSettings[PoseIndex].LayerName.IsNone())
+			{
+				NamedLayers.Add(LayerSettings[PoseIndex].LayerName, PoseIndex);
+			}
+		}
+
+		if (!ActivationCommands.IsValid())
+		{
+			ActivationCommands = MakeShared<TQueue<FMDALayerActivationCommand, EQueueMode::Mpsc>, ESPMode::ThreadSafe>();
+		}
+	}
+
+	// preallocate for the largest layer set so that swapping sets doesn't allocate
+	ActiveLayerSet = nullptr;
+	LayerSetLayers.Reset();
+	LayerSetLayers.Reserve(FMath::Max(MaxLayerSetLayers, LayerSet ? LayerSet->Layers.Num() : 0));
+
+	// initialization may run on a worker thread, where the world and its subsystems can't be used
+	BudgetState.Reset();
+	bRegisterWithBudget = UMDABudgetSubsystem::IsBudgetEnabled();
+
+	BasePose.Initialize(Context);
+	CacheFusedBaseCandidate();
+
+	for (FPoseLink& Pose : Poses)
+	{
+		Pose.Initialize(Context);
+	}
+}
+
+void FAnimNode_MDA::CacheBones_AnyThread(const FAnimationCacheBonesContext& Context)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_ANIMNODE(CacheBones_AnyThread)
+
+	BasePose.CacheBones(Context);
+	CacheFusedBaseCandidate();
+
+	const FBoneContainer& RequiredBones = Context.AnimInstanceProxy->GetRequiredBones();
+	if (RequiredBones.GetSerialNumber() != CachedBonesSerialNumber)
+	{
+		CacheLayerSetRemaps(RequiredBones);
+		CacheReferencePoses(RequiredBones);
+	}
+	
+	for (FPoseLink& Pose : Poses)
+	{
+		Pose.CacheBones(Context);
+	}
+}
+
+void FAnimNode_MDA::InitializeLayerStates(const FAnimationInitializeContext& Context)
+{
+	LayerStates.Reset();
+	LayerStates.SetNum(Poses.Num());
+
+#if MDA_LAYER_DEBUG_STATS
+	LayerDebugStats.Reset();
+	LayerDebugStats.SetNum(Poses.Num());
+#endif
+
+	int32 NumReferencePoses = 0;
+	CurveWeightLayers.Reset();
+
+	const USkeleton* Skeleton = Context.AnimInstanceProxy->GetSkeleton();
+	const UObject* AnimInstanceObject = Context.AnimInstanceProxy->GetAnimInstanceObject();
+
+	for (int32 PoseIndex = 0; PoseIndex < Poses.Num(); ++PoseIndex)
+	{
+		const FMDALayerSettings& Settings = LayerSettings[PoseIndex];
+		FMDALayerState& State = LayerStates[PoseIndex];
+		State.Priority = Settings.Priority;
+
+		if (Settings.Input == EMDALayerInput::FullPoseMinusReference)
+		{
+			// only sequence frames are sampled by the node
+			const bool bSequenceFrame = Settings.ReferencePose == EMDAReferencePose::SequenceFrame && Settings.ReferenceSequence;
+			if (bSequenceFrame && ensureMsgf(NumReferencePoses < FMDALayerState::SkeletonRefPose, TEXT("Too many reference frames, layer %d uses the skeleton ref pose"), PoseIndex))
+			{
+				State.ReferencePoseIndex = static_cast<uint8>(NumReferencePoses++);
+			}
+			else
+			{
+				State.ReferencePoseIndex = FMDALayerState::SkeletonRefPose;
+			}
+		}
+
+		switch (Settings.WeightSource)
+		{
+			case EMDAWeightSource::Curve:
+			{
+				const SmartName::UID_Type CurveUID = Skeleton ? Skeleton->GetUIDByName(USkeleton::AnimCurveMappingName, Settings.WeightCurveName) : SmartName::MaxUID;
+				if (CurveUID == SmartName::MaxUID)
+				{
+					UE_LOG(LogMDA, Warning, TEXT("Layer %d: curve '%s' is not found, weight falls back to the pin"), PoseIndex, *Settings.WeightCurveName.ToString());
+					break;
+				}
+
+				State.WeightSource = EMDAWeightSource::Curve;
+				State.WeightBindingData = CurveWeightLayers.Num();
+
+				FMDACurveWeightLayer& CurveWeightLayer = CurveWeightLayers.AddDefaulted_GetRef();
+				CurveWeightLayer.PoseIndex = PoseIndex;
+				CurveWeightLayer.CurveUID = CurveUID;
+				break;
+			}
+			case EMDAWeightSource::Property:
+			{
+				// Walk the path through struct members, summing up the offsets
+				const UStruct* Struct = AnimInstanceObject ? AnimInstanceObject->GetClass() : nullptr;
+				const FProperty* Property = nullptr;
+				int32 Offset = 0;
+
+				TArray<FString> PathSegments;
+				Settings.WeightPropertyPath.ParseIntoArray(PathSegments, TEXT("."));
+
+				for (const FString& Segment : PathSegments)
+				{
+					Property = Struct ? FindFProperty<FProperty>(Struct, *Segment) : nullptr;
+					if (!Property)
+					{
+						break;
+					}
+
+					Offset += Property->GetOffset_ForInternal();
+
+					const FStructProperty* StructProperty = CastField<FStructProperty>(Property);
+					Struct = StructProperty ? StructProperty->Struct : nullptr;
+				}
+
+				if (!Property || !(Property->IsA<FFloatProperty>() || Property->IsA<FDoubleProperty>()))
+				{
+					UE_LOG(LogMDA, Warning, TEXT("Layer %d: property '%s' is not a float or double variable, weight falls back to the pin"), PoseIndex, *Settings.WeightPropertyPath);
+					break;
+				}
+
+				State.WeightSource = EMDAWeightSource::Property;
+				State.WeightBindingData = Offset;
+				State.bWeightPropertyIsDouble = Property->IsA<FDoubleProperty>();
+				break;
+			}
+			default:
+			{
+				break;
+			}
+		}
+	}
+}
+
+float FAnimNode_MDA::GetLayerWeight(const FMDALayerState& State, int32 PoseIndex, const UObject* AnimInstanceObject) const
+{
+	switch (State.WeightSource)
+	{
+		case EMDAWeightSource::Curve:
+		{
+			return CurveWeightLayers[State.WeightBindingData].LastWeight;
+		}
+		case EMDAWeightSource::Property:
+		{
+			const uint8* ValuePtr = reinterpret_cast<const uint8*>(AnimInstanceObject) + State.WeightBindingData;
+			return State.bWeightPropertyIsDouble ? static_cast<float>(*reinterpret_cast<const double*>(ValuePtr)) : *reinterpret_cast<const float*>(ValuePtr);
+		}
+		default:
+		{
+			return BlendWeights[PoseIndex];
+		}
+	}
+}
+
+void FMDABoneRemap::Build(const USkeleton* InSourceSkeleton, bool bInScaleTranslations, const FBoneContainer& RequiredBones)
+{
+	SourceSkeleton = InSourceSkeleton;
+	bScaleTranslations = bInScaleTranslations;
+
+	const FReferenceSkeleton& SourceRefSkeleton = SourceSkeleton->GetReferenceSkeleton();
+	const FReferenceSkeleton& TargetRefSkeleton = RequiredBones.GetReferenceSkeleton();
+	const TArray<FBoneIndexType>& TargetBoneIndices = RequiredBones.GetBoneIndicesArray();
+
+	// Find the source bone of each target compact bone by name
+	TArray<int32> SourceSkeletonIndices;
+	SourceSkeletonIndices.SetNumUninitialized(TargetBoneIndices.Num());
+
+	TArray<FBoneIndexType> SourceBoneIndices;
+	SourceBoneIndices.Reserve(TargetBoneIndices.Num());
+
+	for (int32 CompactIndex = 0; CompactIndex < TargetBoneIndices.Num(); ++CompactIndex)
+	{
+		const int32 SourceIndex = SourceRefSkeleton.FindBoneIndex(TargetRefSkeleton.GetBoneName(TargetBoneIndices[CompactIndex]));
+		SourceSkeletonIndices[CompactIndex] = SourceIndex;
+
+		if (SourceIndex != INDEX_NONE)
+		{
+			SourceBoneIndices.Add(static_cast<FBoneIndexType>(SourceIndex));
+		}
+	}
+
+	FAnimationRuntime::EnsureParentsPresent(SourceBoneIndices, SourceRefSkeleton);
+	SourceBoneIndices.Sort();
+	SourceBoneContainer.InitializeTo(SourceBoneIndices, FCurveEvaluationOption(false), *const_cast<USkeleton*>(SourceSkeleton));
+
+	SourceCompactIndices.SetNumUninitialized(TargetBoneIndices.Num());
+	TranslationScales.Reset();
+	if (bScaleTranslations)
+	{
+		TranslationScales.Init(1.f, TargetBoneIndices.Num());
+	}
+
+	for (int32 CompactIndex = 0; CompactIndex < TargetBoneIndices.Num(); ++CompactIndex)
+	{
+		const int32 SourceIndex = SourceSkeletonIndices[CompactIndex];
+		if (SourceIndex == INDEX_NONE)
+		{
+			SourceCompactIndices[CompactIndex] = INDEX_NONE;
+			continue;
+		}
+
+		SourceCompactIndices[CompactIndex] = SourceBoneContainer.GetCompactPoseIndexFromSkeletonIndex(SourceIndex).GetInt();
+
+		if (bScaleTranslations)
+		{
+			const double SourceLength = SourceRefSkeleton.GetRefBonePose()[SourceIndex].GetTranslation().Size();
+			const double TargetLength = TargetRefSkeleton.GetRefBonePose()[TargetBoneIndices[CompactIndex]].GetTranslation().Size();
+			if (SourceLength > UE_KINDA_SMALL_NUMBER)
+			{
+				TranslationScales[CompactIndex] = static_cast<float>(TargetLength / SourceLength);
+			}
+		}
+	}
+}
+
+void FAnimNode_MDA::CacheLayerSetRemaps(const FBoneContainer& RequiredBones)
+{
+	LayerSetRemaps.Reset();
+	CachedBonesSerialNumber = RequiredBones.GetSerialNumber();
+
+	const USkeleton* TargetSkeleton = RequiredBones.GetSkeletonAsset();
+
+	for (FMDALayerSetLayer& Layer : LayerSetLayers)
+	{
+		Layer.RemapIndex = INDEX_NONE;
+
+		if (!Layer.SourceSkeleton || Layer.SourceSkeleton == TargetSkeleton)
+		{
+			continue;
+		}
+
+		// layers of the same skeleton share a remap
+		Layer.RemapIndex = LayerSetRemaps.IndexOfByPredicate([&Layer](const FMDABoneRemap& Remap)
+		{
+			return Remap.SourceSkeleton == Layer.SourceSkeleton && Remap.bScaleTranslations == Layer.bScaleTranslations;
+		});
+
+		if (Layer.RemapIndex == INDEX_NONE)
+		{
+			Layer.RemapIndex = LayerSetRemaps.AddDefaulted();
+			LayerSetRemaps[Layer.RemapIndex].Build(Layer.SourceSkeleton, Layer.bScaleTranslations, RequiredBones);
+		}
+	}
+}
+
+void FAnimNode_MDA::CacheReferencePoses(const FBoneContainer& RequiredBones)
+{
+	for (int32 PoseIndex = 0; PoseIndex < Poses.Num(); ++PoseIndex)
+	{
+		const uint8 ReferencePoseIndex = LayerStates[PoseIndex].ReferencePoseIndex;
+		if (ReferencePoseIndex == FMDALayerState::NoReferencePose || ReferencePoseIndex == FMDALayerState::SkeletonRefPose)
+		{
+			continue;
+		}
+
+		const FMDALayerSettings& Settings = LayerSettings[PoseIndex];
+		if (ReferencePoseIndex >= ReferencePoses.Num())
+		{
+			ReferencePoses.SetNum(ReferencePoseIndex + 1);
+		}
+
+		TArray<FTransform>& ReferenceTransforms = ReferencePoses[ReferencePoseIndex];
+		ReferenceTransforms.Reset();
+
+		// sample the frame once
+		FCompactPose ReferencePose;
+		ReferencePose.SetBoneContainer(&RequiredBones);
+		FBlendedCurve ReferenceCurve;
+		ReferenceCurve.InitFrom(RequiredBones);
+		UE::Anim::FStackAttributeContainer ReferenceAttributes;
+
+		FAnimationPoseData PoseData(ReferencePose, ReferenceCurve, ReferenceAttributes);
+		Settings.ReferenceSequence->GetAnimationPose(PoseData, FAnimExtractContext(static_cast<double>(Settings.ReferenceSequence->GetTimeAtFrame(Settings.ReferenceFrame))));
+
+		ReferenceTransforms.Append(ReferencePose.GetBones());
+	}
+}
+
+void FAnimNode_MDA::UpdateLayerSet(const FAnimationUpdateContext& Context)
+{
+	if (LayerSet != ActiveLayerSet)
+	{
+		ActiveLayerSet = LayerSet;
+		LayerSetLayers.Reset();
+
+		if (ActiveLayerSet)
+		{
+			for (const FMDALayerSetEntry& Entry : ActiveLayerSet->Layers)
+			{
+				// layers that would never contribute are not carried
+				if (Entry.Sequence && FAnimWeight::IsRelevant(Entry.Weight))
+				{
+					FMDALayerSetLayer& Layer = LayerSetLayers.AddDefaulted_GetRef();
+					Layer.Sequence = Entry.Sequence;
+					Layer.SourceSkeleton = Entry.SourceSkeleton ? Entry.SourceSkeleton.Get() : Entry.Sequence->GetSkeleton();
+					Layer.bScaleTranslations = Entry.bScaleTranslations;
+					Layer.Weight = Entry.Weight;
+					Layer.PlayRate = Entry.PlayRate;
+					Layer.BlendMode = Entry.BlendMode;
+					Layer.bLoop = Entry.bLoop;
+					Layer.Priority = Entry.Priority;
+				}
+			}
+		}
+
+		CacheLayerSetRemaps(Context.AnimInstanceProxy->GetRequiredBones());
+	}
+
+	const float DeltaTime = Context.GetDeltaTime();
+
+	for (FMDALayerSetLayer& Layer : LayerSetLayers)
+	{
+		const float PlayLength = Layer.Sequence->GetPlayLength();
+		Layer.Time += DeltaTime * Layer.PlayRate;
+
+		if (Layer.bLoop && PlayLength > 0.f)
+		{
+			Layer.Time = FMath::Fmod(Layer.Time, PlayLength);
+			if (Layer.Time < 0.f)
+			{
+				Layer.Time += PlayLength;
+			}
+		}
+		else
+		{
+			Layer.Time = FMath::Clamp(Layer.Time, 0.f, PlayLength);
+		}
+	}
+}
+
+void FAnimNode_MDA::Update_AnyThread(const FAnimationUpdateContext& Context)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_ANIMNODE(Update_AnyThread)
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_FAnimationNode_MDA_Update);
+
+	// commands are applied first, so that a node with no active layer doesn't copy weights nothing reads
+	const bool bEvents = ActivationMode == EMDAActivationMode::Events;
+	if (bEvents && ActivationCommands.IsValid())
+	{
+		ApplyActivationCommands();
+	}
+
+	// weights bound to curves or properties and unlinked pins are compiled into the node, with nothing to copy
+	if ((bHasLinkedWeights && (!bEvents || ActiveLayers.Num() > 0)) || bHasLinkedInputs)
+	{
+		GetEvaluateGraphExposedInputs().Execute(Context);
+	}
+
+	BasePose.Update(Context);
+
+	const UObject* AnimInstanceObject = Context.AnimInstanceProxy->GetAnimInstanceObject();
+
+	// decided by the budget subsystem on the game thread
+	const uint8 DropBelowPriority = BudgetState ? BudgetState->DropBelowPriority.load(std::memory_order_relaxed) : 0;
+
+	if (bEvents)
+	{
+		UpdateActiveLayers(Context, DropBelowPriority);
+	}
+	else
+	{
+		for (int32 PoseIndex = 0; PoseIndex < Poses.Num(); ++PoseIndex)
+		{
+			FMDALayerState& State = LayerStates[PoseIndex];
+			if (State.Priority < DropBelowPriority)
+			{
+				State.ActualAlpha = 0.f;
+				continue;
+			}
+
+			State.ActualAlpha = AlphaScaleBiasClamp.ApplyTo(GetLayerWeight(State, PoseIndex, AnimInstanceObject), Context.GetDeltaTime());
+			if (State.ActualAlpha > ZERO_ANIMWEIGHT_THRESH)
+			{
+				Poses[PoseIndex].Update(Context);
+			}
+		}
+	}
+
+	UpdateLayerSet(Context);
+}
+
+void FAnimNode_MDA::PreUpdate(const UAnimInstance* InAnimInstance)
+{
+	if (!bRegisterWithBudget)
+	{
+		return;
+	}
+
+	bRegisterWithBudget = false;
+	const UWorld* World = InAnimInstance ? InAnimInstance->GetWorld() : nullptr;
+	if (UMDABudgetSubsystem* BudgetSubsystem = World ? World->GetSubsystem<UMDABudgetSubsystem>() : nullptr)
+	{
+		BudgetState = BudgetSubsystem->Register(InAnimInstance);
+	}
+}
+
+void FAnimNode_MDA::EnqueueLayerActivation(FName LayerName, float BlendTime, bool bActivate)
+{
+	if (ActivationMode != EMDAActivationMode::Events || !ActivationCommands.IsValid())
+	{
+		return;
+	}
+
+	FMDALayerActivationCommand Command;
+	Command.LayerName = LayerName;
+	Command.BlendTime = BlendTime;
+	Command.bActivate = bActivate;
+	ActivationCommands->Enqueue(Command);
+}
+
+void FAnimNode_MDA::ApplyActivationCommands()
+{
+	FMDALayerActivationCommand Command;
+	while (ActivationCommands->Dequeue(Command))
+	{
+		if (Command.LayerName.IsNone())
+		{
+			continue;
+		}
+
+		for (TMultiMap<FName, int32>::TConstKeyIterator It = NamedLayers.CreateConstKeyIterator(Command.LayerName); It; ++It)
+		{
+			const int32 PoseIndex = It.Value();
+
+			// the list stays in pose order, as layers are accumulated in that order
+			const int32 Index = Algo::LowerBoundBy(ActiveLayers, PoseIndex, &FMDAActiveLayer::PoseIndex);
+			if (!ActiveLayers.IsValidIndex(Index) || ActiveLayers[Index].PoseIndex != PoseIndex)
+			{
+				if (!Command.bActivate)
+				{
+					continue;
+				}
+
+				ActiveLayers.InsertDefaulted(Index);
+				ActiveLayers[Index].PoseIndex = PoseIndex;
+			}
+
+			FMDAActiveLayer& ActiveLayer = ActiveLayers[Index];
+			ActiveLayer.TargetAlpha = Command.bActivate ? 1.f : 0.f;
+			ActiveLayer.BlendRate = Command.BlendTime > 0.f ? 1.f / Command.BlendTime : 0.f;
+		}
+	}
+}
+
+void FAnimNode_MDA::UpdateActiveLayers(const FAnimationUpdateContext& Context, uint8 DropBelowPriority)
+{
+	const UObject* AnimInstanceObject = Context.AnimInstanceProxy->GetAnimInstanceObject();
+	const float DeltaTime = Context.GetDeltaTime();
+
+	// layers that have blended out are compacted away
+	int32 NumActiveLayers = 0;
+	for (int32 Index = 0; Index < ActiveLayers.Num(); ++Index)
+	{
+		FMDAActiveLayer& ActiveLayer = ActiveLayers[Index];
+		FMDALayerState& State = LayerStates[ActiveLayer.PoseIndex];
+
+		ActiveLayer.Alpha = ActiveLayer.BlendRate > 0.f ? FMath::FInterpConstantTo(ActiveLayer.Alpha, ActiveLayer.TargetAlpha, DeltaTime, ActiveLayer.BlendRate) : ActiveLayer.TargetAlpha;
+		if (ActiveLayer.Alpha <= 0.f && ActiveLayer.TargetAlpha <= 0.f)
+		{
+			State.ActualAlpha = 0.f;
+			continue;
+		}
+
+		ActiveLayers[NumActiveLayers++] = ActiveLayer;
+
+		if (State.Priority < DropBelowPriority)
+		{
+			State.ActualAlpha = 0.f;
+			continue;
+		}
+
+		State.ActualAlpha = AlphaScaleBiasClamp.ApplyTo(GetLayerWeight(State, ActiveLayer.PoseIndex, AnimInstanceObject) * ActiveLayer.Alpha, DeltaTime);
+		if (State.ActualAlpha > ZERO_ANIMWEIGHT_THRESH)
+		{
+			Poses[ActiveLayer.PoseIndex].Update(Context);
+		}
+	}
+	ActiveLayers.SetNum(NumActiveLayers, false);
+}
+
+uint64 FAnimNode_MDA::BuildSharingKey(const FAnimInstanceProxy* Proxy) const
+{
+	// the key of a sequence player is its sequence and time, the compiler has checked the type of the linked node
+	auto CombineSequencePlayer = [](uint64& Key, const FPoseLink& Link)
+	{
+		const FAnimNode_SequencePlayerBase* SequencePlayer = static_cast<const FAnimNode_SequencePlayerBase*>(Link.GetLinkNode());
+		if (!SequencePlayer || !SequencePlayer->GetSequence())
+		{
+			return false;
+		}
+
+		Key = FMDAResultSharing::CombineKey(Key, reinterpret_cast<UPTRINT>(SequencePlayer->GetSequence()));
+		Key = FMDAResultSharing::CombineKeyFloat(Key, SequencePlayer->GetAccumulatedTime());
+		return true;
+	};
+
+	const FBoneContainer& RequiredBones = Proxy->GetRequiredBones();
+
+	// the same node of the same class has the same links, on the same mesh and LOD it has the same bones. Settings that can
+	// change per instance, the blend modes and the inputs of layers, are combined per layer below
+	uint64 Key = FMDAResultSharing::CombineKey(static_cast<uint64>(SharingGroup), reinterpret_cast<UPTRINT>(Proxy->GetAnimClassInterface()));
+	Key = FMDAResultSharing::CombineKey(Key, reinterpret_cast<UPTRINT>(this) - reinterpret_cast<UPTRINT>(Proxy->GetAnimInstanceObject()));
+	Key = FMDAResultSharing::CombineKey(Key, reinterpret_cast<UPTRINT>(RequiredBones.GetAsset()));
+	Key = FMDAResultSharing::CombineKey(Key, static_cast<uint64>(Proxy->GetLODLevel()));
+	Key = FMDAResultSharing::CombineKey(Key, static_cast<uint64>(RequiredBones.GetCompactPoseNumBones()));
+	Key = FMDAResultSharing::CombineKey(Key, static_cast<uint64>(CurveBlendOption));
+
+	if (bBasePoseIsSequencePlayer)
+	{
+		if (!CombineSequencePlayer(Key, BasePose))
+		{
+			return 0;
+		}
+	}
+	else if (bBasePoseIsMDA)
+	{
+		// the base node evaluates after us, so its key is built here
+		const FAnimNode_MDA* BaseNode = static_cast<const FAnimNode_MDA*>(BasePose.GetLinkNode());
+		const uint64 BaseKey = BaseNode && BaseNode->bEnableResultSharing ? BaseNode->BuildSharingKey(Proxy) : 0;
+		if (BaseKey == 0)
+		{
+			return 0;
+		}
+		Key = FMDAResultSharing::CombineKey(Key, BaseKey);
+	}
+	else
+	{
+		return 0;
+	}
+
+	bool bLayersKnown = true;
+	ForEachLiveLayer([this, &Key, &bLayersKnown, &CombineSequencePlayer](int32 PoseIndex)
+	{
+		const FMDALayerState& State = LayerStates[PoseIndex];
+		const FMDALayerSettings& Settings = LayerSettings[PoseIndex];
+		Key = FMDAResultSharing::CombineKey(Key, static_cast<uint64>(PoseIndex));
+		Key = FMDAResultSharing::CombineKeyFloat(Key, State.ActualAlpha);
+		Key = FMDAResultSharing::CombineKey(Key, static_cast<uint64>(BlendModes[PoseIndex]));
+		Key = FMDAResultSharing::CombineKey(Key, static_cast<uint64>(Settings.Input));
+		if (Settings.Input == EMDALayerInput::FullPoseMinusReference)
+		{
+			Key = FMDAResultSharing::CombineKey(Key, static_cast<uint64>(Settings.ReferencePose));
+			Key = FMDAResultSharing::CombineKey(Key, reinterpret_cast<UPTRINT>(Settings.ReferenceSequence.Get()));
+			Key = FMDAResultSharing::CombineKey(Key, static_cast<uint64>(Settings.ReferenceFrame));
+		}
+		if (State.ActualAlpha > ZERO_ANIMWEIGHT_THRESH && !(PoseIsSequencePlayer.IsValidIndex(PoseIndex) && PoseIsSequencePlayer[PoseIndex] && CombineSequencePlayer(Key, Poses[PoseIndex])))
+		{
+			bLayersKnown = false;
+		}
+	});
+
+	if (!bLayersKnown)
+	{
+		return 0;
+	}
+
+	Key = FMDAResultSharing::CombineKey(Key, reinterpret_cast<UPTRINT>(ActiveLayerSet));
+	Key = FMDAResultSharing::CombineKey(Key, BudgetState ? BudgetState->DropBelowPriority.load(std::memory_order_relaxed) : 0);
+	for (const FMDALayerSetLayer& Layer : LayerSetLayers)
+	{
+		Key = FMDAResultSharing::CombineKeyFloat(Key, Layer.Time);
+	}
+
+	// 0 is reserved for no key
+	return Key != 0 ? Key : 1;
+}
+
+void FAnimNode_MDA::GatherSharedCurveWeights(TArray<float, TInlineAllocator<8>>& OutWeights) const
+{
+	for (const FMDACurveWeightLayer& CurveWeightLayer : CurveWeightLayers)
+	{
+		OutWeights.Add(CurveWeightLayer.LastWeight);
+	}
+
+	// the key of this node covers the MDA node of the base pose, so it is copied too
+	const FAnimNode_MDA* BaseNode = bBasePoseIsMDA ? static_cast<const FAnimNode_MDA*>(BasePose.GetLinkNode()) : nullptr;
+	if (BaseNode)
+	{
+		BaseNode->GatherSharedCurveWeights(OutWeights);
+	}
+}
+
+int32 FAnimNode_MDA::ApplySharedResult(TArrayView<const float> CurveWeights)
+{
+	// the curves of the base pose were the same for the node that published the result
+	int32 NumWeightsRead = 0;
+	for (FMDACurveWeightLayer& CurveWeightLayer : CurveWeightLayers)
+	{
+		CurveWeightLayer.LastWeight = CurveWeights[NumWeightsRead++];
+	}
+
+#if MDA_LAYER_DEBUG_STATS
+	// relevant layers were evaluated by the publisher, at no cost here
+	ForEachLiveLayer([this](int32 PoseIndex)
+	{
+		if (LayerStates[PoseIndex].ActualAlpha > ZERO_ANIMWEIGHT_THRESH && LayerDebugStats.IsValidIndex(PoseIndex))
+		{
+			FMDALayerDebugStats& Stats = LayerDebugStats[PoseIndex];
+			Stats.AverageMicroseconds = Stats.LastEvaluatedFrame != 0 ? FMath::Lerp(Stats.AverageMicroseconds, 0.f, 0.1f) : 0.f;
+			Stats.LastEvaluatedFrame = GFrameCounter;
+		}
+	});
+#endif
+
+	FAnimNode_MDA* BaseNode = bBasePoseIsMDA ? static_cast<FAnimNode_MDA*>(BasePose.GetLinkNode()) : nullptr;
+	if (BaseNode)
+	{
+		NumWeightsRead += BaseNode->ApplySharedResult(CurveWeights.RightChop(NumWeightsRead));
+	}
+
+	return NumWeightsRead;
+}
 
-void FAnimNode_MDA::Initialize_AnyThread(const FAnimationInitializeContext& Context)
+void FAnimNode_MDA::Evaluate_AnyThread(FPoseContext& Output)
 {
-	DECLARE_SCOPE_HIERARCHICAL_COUNTER_ANIMNODE(Initialize_AnyThread)
-	FAnimNode_Base::Initialize_AnyThread(Context);
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_ANIMNODE(Evaluate_AnyThread)
 
-	// this should be consistent all the time by editor node
-	if (!ensure(Poses.Num() == BlendWeights.Num()))
+	// built here rather than in update, as asset players advance their times after the graph update
+	const uint64 SharingKey = bEnableResultSharing && FMDAResultSharing::IsEnabled() ? BuildSharingKey(Output.AnimInstanceProxy) : 0;
+
+	// sized by gathering, the values are replaced on a hit
+	TArray<float, TInlineAllocator<8>> SharedCurveWeights;
+	if (SharingKey != 0)
 	{
-		BlendWeights.Init(0.f, Poses.Num());
+		GatherSharedCurveWeights(SharedCurveWeights);
+		if (FMDAResultSharing::TryCopy(SharingKey, Output.Pose, Output.Curve, Output.CustomAttributes, SharedCurveWeights))
+		{
+			ApplySharedResult(SharedCurveWeights);
+			return;
+		}
 	}
 
-	if (!ensure(Poses.Num() == BlendModes.Num()))
+	if (bEnableResultSharing && SharingKey == 0)
 	{
-		BlendModes.Init(EMDABlendMode::Add, Poses.Num());
+		FMDAResultSharing::AddIneligible();
 	}
-	// ActualAlphas = BlendWeights;
-	ActualAlphas.Init(0.f, Poses.Num());
 
-	AlphaScaleBiasClamp.Reinitialize();
+	// this function may be reentrant when multiple multiblend nodes are chained together
+	// these scratch arrays are treated as stacks below
+	FMDAData& BlendData = FMDAData::Get();
+	TArray<FCompactPose, TInlineAllocator<8>>& SourcePoses = BlendData.SourcePoses;
+	TArray<FBlendedCurve, TInlineAllocator<8>>& SourceCurves = BlendData.SourceCurves;
+	TArray<UE::Anim::FStackAttributeContainer, TInlineAllocator<8>>& SourceAttributes = BlendData.SourceAttributes;
+	TArray<float, TInlineAllocator<8>>& SourceWeights = BlendData.SourceWeights;
+	TArray<EMDABlendMode, TInlineAllocator<8>>& SourceBlendModes = BlendData.SourceBlendModes;
+	TArray<FMDALayerSource, TInlineAllocator<8>>& SourceLayers = BlendData.SourceLayers;
 
-	BasePose.Initialize(Context);
+	const int32 SourcePosesInitialNum = SourcePoses.Num();
 
-	for (FPoseLink& Pose : Poses)
+	const bool bMeasureCost = BudgetState && !BlendData.bMeasuringCost;
+	const uint64 StartCycles = bMeasureCost ? FPlatformTime::Cycles64() : 0;
+	if (bMeasureCost)
 	{
-		Pose.Initialize(Context);
+		BlendData.bMeasuringCost = true;
+		BlendData.BasePoseCycles = 0;
 	}
-}
+	++BlendData.EvaluateDepth;
+	BlendData.EvaluateHighWater = FMath::Max(BlendData.EvaluateHighWater, BlendData.EvaluateDepth);
 
-void FAnimNode_MDA::CacheBones_AnyThread(const FAnimationCacheBonesContext& Context)
-{
-	DECLARE_SCOPE_HIERARCHICAL_COUNTER_ANIMNODE(CacheBones_AnyThread)
+	// pushes the layers of this node, and of the fused nodes below it, and evaluates the base pose
+	const int32 SourcePosesAdded = EvaluateChain(Output, BlendData);
+	BlendData.StackHighWater = FMath::Max(BlendData.StackHighWater, SourcePoses.Num());
+	BlendData.AllocatedHighWater = FMath::Max(BlendData.AllocatedHighWater, BlendData.GetAllocatedSize());
 
-	BasePose.CacheBones(Context);
-	
-	for (FPoseLink& Pose : Poses)
+	if (SourcePosesAdded > 0)
 	{
-		Pose.CacheBones(Context);
+		// obtain views onto the ends of our stacks
+		TArrayView<FCompactPose> SourcePosesView = MakeArrayView(&SourcePoses[SourcePosesInitialNum], SourcePosesAdded);
+		TArrayView<FBlendedCurve> SourceCurvesView = MakeArrayView(&SourceCurves[SourcePosesInitialNum], SourcePosesAdded);
+		TArrayView<float> SourceWeightsView = MakeArrayView(&SourceWeights[SourcePosesInitialNum], SourcePosesAdded);
+		TArrayView<EMDABlendMode> SourceBlendModesView = MakeArrayView(&SourceBlendModes[SourcePosesInitialNum], SourcePosesAdded);
+		TArrayView<FMDALayerSource> SourceLayersView = MakeArrayView(&SourceLayers[SourcePosesInitialNum], SourcePosesAdded);
+
+		// Accumulate Additive Poses
+		FAnimationPoseData OutputAnimationPoseData(Output);
+		AccumulateAdditivePose(SourcePosesView, SourceCurvesView, SourceWeightsView, SourceBlendModesView, SourceLayersView, OutputAnimationPoseData);
+
+		// pop the poses we added
+		SourcePoses.SetNum(SourcePosesInitialNum, false);
+		SourceCurves.SetNum(SourcePosesInitialNum, false);
+		SourceWeights.SetNum(SourcePosesInitialNum, false);
+		SourceAttributes.SetNum(SourcePosesInitialNum, false);
+		SourceBlendModes.SetNum(SourcePosesInitialNum, false);
+		SourceLayers.SetNum(SourcePosesInitialNum, false);
 	}
-}
 
+	if (SharingKey != 0)
+	{
+		SharedCurveWeights.Reset();
+		GatherSharedCurveWeights(SharedCurveWeights);
+		FMDAResultSharing::Publish(SharingKey, Output.Pose, Output.Curve, Output.CustomAttributes, SharedCurveWeights);
+	}
 
+	--BlendData.EvaluateDepth;
+	if (bMeasureCost)
+	{
+		// dropping layers can't make the base pose cheaper
+		const uint64 Cycles = FPlatformTime::Cycles64() - StartCycles;
+		BudgetState->Cycles.fetch_add(Cycles - FMath::Min(BlendData.BasePoseCycles, Cycles), std::memory_order_relaxed);
+		BlendData.bMeasuringCost = false;
+	}
+}
 
-void FAnimNode_MDA::Update_AnyThread(const FAnimationUpdateContext& Context)
+void FAnimNode_MDA::CacheFusedBaseCandidate()
 {
-	DECLARE_SCOPE_HIERARCHICAL_COUNTER_ANIMNODE(Update_AnyThread)
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_FAnimationNode_MDA_Update);
-	GetEvaluateGraphExposedInputs().Execute(Context);
-
-	BasePose.Update(Context);
+	FusedBaseCandidate = nullptr;
 
-	for (int32 PoseIndex = 0; PoseIndex < Poses.Num(); ++PoseIndex)
+	// curve weights are read from the base pose, which isn't built separately in a fused chain
+	if (!bBasePoseIsMDA || !bAllowChainFusion || CurveWeightLayers.Num() > 0)
 	{
-		ActualAlphas[PoseIndex] = AlphaScaleBiasClamp.ApplyTo(BlendWeights[PoseIndex], Context.GetDeltaTime());
-		if (ActualAlphas[PoseIndex] > ZERO_ANIMWEIGHT_THRESH)
-		{
-			Poses[PoseIndex].Update(Context);
-		}
+		return;
 	}
+
+	// the compiler has checked the type of the linked node
+	FusedBaseCandidate = static_cast<FAnimNode_MDA*>(BasePose.GetLinkNode());
 }
 
-void FAnimNode_MDA::Evaluate_AnyThread(FPoseContext& Output)
+FAnimNode_MDA* FAnimNode_MDA::GetFusedBaseNode() const
 {
-	DECLARE_SCOPE_HIERARCHICAL_COUNTER_ANIMNODE(Evaluate_AnyThread)
+	// normalizing by weight doesn't distribute over the chain. The options can be bound to pins, so they are checked here
+	if (!FusedBaseCandidate || FusedBaseCandidate->CurveBlendOption != CurveBlendOption || CurveBlendOption == ECurveBlendOption::NormalizeByWeight)
+	{
+		return nullptr;
+	}
 
-	// this function may be reentrant when multiple multiblend nodes are chained together
-	// these scratch arrays are treated as stacks below
-	FMDAData& BlendData = FMDAData::Get();
+	return FusedBaseCandidate;
+}
+
+int32 FAnimNode_MDA::EvaluateChain(FPoseContext& Output, FMDAData& BlendData)
+{
 	TArray<FCompactPose, TInlineAllocator<8>>& SourcePoses = BlendData.SourcePoses;
 	TArray<FBlendedCurve, TInlineAllocator<8>>& SourceCurves = BlendData.SourceCurves;
 	TArray<UE::Anim::FStackAttributeContainer, TInlineAllocator<8>>& SourceAttributes = BlendData.SourceAttributes;
 	TArray<float, TInlineAllocator<8>>& SourceWeights = BlendData.SourceWeights;
 	TArray<EMDABlendMode, TInlineAllocator<8>>& SourceBlendModes = BlendData.SourceBlendModes;
+	TArray<FMDALayerSource, TInlineAllocator<8>>& SourceLayers = BlendData.SourceLayers;
 
-	const int32 SourcePosesInitialNum = SourcePoses.Num();
 	int32 SourcePosesAdded = 0;
 
-	if (ensure(Poses.Num() == ActualAlphas.Num()))
+	// a fused base node pushes its layers first, as they apply to the base before ours
+	FAnimNode_MDA* FusedNode = GetFusedBaseNode();
+	if (FusedNode)
 	{
-		for (int32 PoseIndex = 0; PoseIndex < Poses.Num(); ++PoseIndex)
+		SourcePosesAdded += FusedNode->EvaluateChain(Output, BlendData);
+	}
+
+	// the layers of this level, whose attributes are blended together once the base is evaluated
+	const int32 LevelBegin = SourceAttributes.Num();
+
+	if (ensure(Poses.Num() == LayerStates.Num()))
+	{
+		ForEachLiveLayer([this, &Output, &SourcePoses, &SourceCurves, &SourceAttributes, &SourceWeights, &SourceBlendModes, &SourceLayers, &SourcePosesAdded](int32 PoseIndex)
 		{
-			const float CurrentAlpha = ActualAlphas[PoseIndex];
+			const FMDALayerState& State = LayerStates[PoseIndex];
+			const float CurrentAlpha = State.ActualAlpha;
 			const EMDABlendMode CurrentBlendModes = BlendModes[PoseIndex];
 			if (CurrentAlpha > ZERO_ANIMWEIGHT_THRESH)
 			{
+				// a full pose applied as an additive breaks the pose, so the layer is skipped without its reference pose
+				TArrayView<const FTransform> ReferencePose;
+				if (State.ReferencePoseIndex != FMDALayerState::NoReferencePose)
+				{
+					const FBoneContainer& RequiredBones = Output.AnimInstanceProxy->GetRequiredBones();
+					if (State.ReferencePoseIndex == FMDALayerState::SkeletonRefPose)
+					{
+						ReferencePose = RequiredBones.GetRefPoseCompactArray();
+					}
+					else if (ReferencePoses.IsValidIndex(State.ReferencePoseIndex))
+					{
+						ReferencePose = ReferencePoses[State.ReferencePoseIndex];
+					}
+
+					if (!ensureMsgf(ReferencePose.Num() == RequiredBones.GetCompactPoseNumBones(), TEXT("Layer %d takes a full pose, but its reference pose is not cached for the required bones. The layer is skipped"), PoseIndex))
+					{
+						return;
+					}
+				}
+
+#if MDA_LAYER_DEBUG_STATS
+				const uint64 StartCycles = FPlatformTime::Cycles64();
+#endif
+
 				// evaluate input pose, potentially reentering this function and pushing/popping more poses
 				FPoseContext PoseContext(Output);
 				Poses[PoseIndex].Evaluate(PoseContext);
 
+#if MDA_LAYER_DEBUG_STATS
+				if (LayerDebugStats.IsValidIndex(PoseIndex))
+				{
+					FMDALayerDebugStats& Stats = LayerDebugStats[PoseIndex];
+					const float Microseconds = static_cast<float>(FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles) * 1000.0);
+					Stats.AverageMicroseconds = Stats.LastEvaluatedFrame != 0 ? FMath::Lerp(Stats.AverageMicroseconds, Microseconds, 0.1f) : Microseconds;
+					Stats.LastEvaluatedFrame = GFrameCounter;
+				}
+#endif
+
 				// push source pose data
 				FCompactPose& SourcePose = SourcePoses.AddDefaulted_GetRef();
 				SourcePose.MoveBonesFrom(PoseContext.Pose);
@@ -121,33 +1015,107 @@ void FAnimNode_MDA::Evaluate_AnyThread(FPoseContext& Output)
 
 				SourceBlendModes.Add(CurrentBlendModes);
 
+				SourceLayers.AddDefaulted_GetRef().ReferencePose = ReferencePose;
+
 				++SourcePosesAdded;
 			}
-		}
+		});
 	}
 
-	BasePose.Evaluate(Output);
+	const uint8 DropBelowPriority = BudgetState ? BudgetState->DropBelowPriority.load(std::memory_order_relaxed) : 0;
 
-	if (SourcePosesAdded > 0)
+	for (const FMDALayerSetLayer& Layer : LayerSetLayers)
 	{
-		// obtain views onto the ends of our stacks
-		TArrayView<FCompactPose> SourcePosesView = MakeArrayView(&SourcePoses[SourcePosesInitialNum], SourcePosesAdded);
-		TArrayView<FBlendedCurve> SourceCurvesView = MakeArrayView(&SourceCurves[SourcePosesInitialNum], SourcePosesAdded);
-		TArrayView<UE::Anim::FStackAttributeContainer> SourceAttributesView = MakeArrayView(&SourceAttributes[SourcePosesInitialNum], SourcePosesAdded);
-		TArrayView<float> SourceWeightsView = MakeArrayView(&SourceWeights[SourcePosesInitialNum], SourcePosesAdded);
-		TArrayView<EMDABlendMode> SourceBlendModesView = MakeArrayView(&SourceBlendModes[SourcePosesInitialNum], SourcePosesAdded);
+		if (Layer.Priority < DropBelowPriority)
+		{
+			continue;
+		}
 
-		// Accumulate Additive Poses
-		FAnimationPoseData OutputAnimationPoseData(Output);
-		AccumulateAdditivePose(SourcePosesView, SourceCurvesView, SourceAttributesView, SourceWeightsView, SourceBlendModesView, OutputAnimationPoseData);
+		// sample the sequence directly, no pose link is involved
+		if (Layer.RemapIndex != INDEX_NONE)
+		{
+			// keep the pose on the source skeleton, the kernels read it through the remap
+			const FMDABoneRemap& Remap = LayerSetRemaps[Layer.RemapIndex];
 
-		// pop the poses we added
-		SourcePoses.SetNum(SourcePosesInitialNum, false);
-		SourceCurves.SetNum(SourcePosesInitialNum, false);
-		SourceWeights.SetNum(SourcePosesInitialNum, false);
-		SourceAttributes.SetNum(SourcePosesInitialNum, false);
-		SourceBlendModes.SetNum(SourcePosesInitialNum, false);
+			FCompactPose& SourcePose = SourcePoses.AddDefaulted_GetRef();
+			SourcePose.SetBoneContainer(&Remap.SourceBoneContainer);
+
+			// curves of another skeleton don't share smart names, so they are not blended
+			FBlendedCurve& SourceCurve = SourceCurves.AddDefaulted_GetRef();
+			SourceCurve.InitFrom(Output.Curve);
+
+			FBlendedCurve RemappedCurve;
+			RemappedCurve.InitFrom(Remap.SourceBoneContainer);
+
+			// attributes are bone indexed as well
+			SourceAttributes.AddDefaulted();
+			UE::Anim::FStackAttributeContainer RemappedAttributes;
+
+			FAnimationPoseData PoseData(SourcePose, RemappedCurve, RemappedAttributes);
+			Layer.Sequence->GetAnimationPose(PoseData, FAnimExtractContext(static_cast<double>(Layer.Time)));
+
+			SourceLayers.AddDefaulted_GetRef().Remap = &Remap;
+		}
+		else
+		{
+			FPoseContext PoseContext(Output);
+			FAnimationPoseData PoseData(PoseContext);
+			Layer.Sequence->GetAnimationPose(PoseData, FAnimExtractContext(static_cast<double>(Layer.Time)));
+
+			FCompactPose& SourcePose = SourcePoses.AddDefaulted_GetRef();
+			SourcePose.MoveBonesFrom(PoseContext.Pose);
+
+			FBlendedCurve& SourceCurve = SourceCurves.AddDefaulted_GetRef();
+			SourceCurve.MoveFrom(PoseContext.Curve);
+
+			UE::Anim::FStackAttributeContainer& SourceAttribute = SourceAttributes.AddDefaulted_GetRef();
+			SourceAttribute.MoveFrom(PoseContext.CustomAttributes);
+
+			SourceLayers.AddDefaulted();
+		}
+
+		SourceWeights.Add(Layer.Weight);
+
+		SourceBlendModes.Add(Layer.BlendMode);
+
+		++SourcePosesAdded;
+	}
+
+	if (!FusedNode)
+	{
+		if (BlendData.bMeasuringCost)
+		{
+			// the base pose is left out of the measured cost, MDA nodes in it measure themselves
+			const uint64 StartCycles = FPlatformTime::Cycles64();
+			const uint64 OuterBasePoseCycles = BlendData.BasePoseCycles;
+			BlendData.bMeasuringCost = false;
+
+			BasePose.Evaluate(Output);
+
+			BlendData.bMeasuringCost = true;
+			BlendData.BasePoseCycles = OuterBasePoseCycles + FPlatformTime::Cycles64() - StartCycles;
+		}
+		else
+		{
+			BasePose.Evaluate(Output);
+		}
 	}
+
+	// Blending the attributes of all fused layers at once gives other results than one level after the other. The stacks may
+	// have grown while evaluating, so the views are taken here
+	const int32 NumLevelLayers = SourceAttributes.Num() - LevelBegin;
+	if (NumLevelLayers > 0)
+	{
+		UE::Anim::Attributes::BlendAttributes(MakeArrayView(&SourceAttributes[LevelBegin], NumLevelLayers), MakeArrayView(&SourceWeights[LevelBegin], NumLevelLayers), Output.CustomAttributes);
+	}
+
+	// Store curve weights for the next update
+	for (FMDACurveWeightLayer& CurveWeightLayer : CurveWeightLayers)
+	{
+		CurveWeightLayer.LastWeight = Output.Curve.Get(CurveWeightLayer.CurveUID);
+	}
+
+	return SourcePosesAdded;
 }
 
 void FAnimNode_MDA::GatherDebugData(FNodeDebugData& DebugData)
@@ -156,7 +1124,7 @@ void FAnimNode_MDA::GatherDebugData(FNodeDebugData& DebugData)
 	const int NumPoses = Poses.Num();
 	
 	FString DebugLine = DebugData.GetNodeName(this);
-	DebugLine += FString::Printf(TEXT("(Num Poses: %i)"), NumPoses);
+	DebugLine += FString::Printf(TEXT("(Num Poses: %i, Layer Set: %s (%i), Memory: %llu bytes)"), NumPoses, *GetNameSafe(ActiveLayerSet), LayerSetLayers.Num(), static_cast<uint64>(GetInstanceMemorySize()));
 	DebugData.AddDebugItem(DebugLine);
 
 	BasePose.GatherDebugData(DebugData.BranchFlow(1.f));
@@ -168,46 +1136,92 @@ void FAnimNode_MDA::GatherDebugData(FNodeDebugData& DebugData)
 	// TODO: More info for debugging
 }
 
-void FAnimNode_MDA::AccumulateAdditivePose(TArrayView<const FCompactPose> SourcePoses, TArrayView<const FBlendedCurve> SourceCurves, TArrayView<const UE::Anim::FStackAttributeContainer> SourceAttributes, TArrayView<const float> SourceWeights, TArrayView<const EMDABlendMode> SourceBlendModes, FAnimationPoseData& OutAnimationPoseData)
+SIZE_T FAnimNode_MDA::GetInstanceMemorySize() const
 {
-	check(SourcePoses.Num() > 0);
+	SIZE_T Size = sizeof(FAnimNode_MDA);
 
-	// Get out anim data
-	FCompactPose& OutPose = OutAnimationPoseData.GetPose();
-	FBlendedCurve& OutCurve = OutAnimationPoseData.GetCurve();
-	UE::Anim::FStackAttributeContainer& OutAttributes = OutAnimationPoseData.GetAttributes();
+	Size += Poses.GetAllocatedSize();
+	Size += BlendWeights.GetAllocatedSize();
+	Size += BlendModes.GetAllocatedSize();
+	Size += LayerSettings.GetAllocatedSize();
+	for (const FMDALayerSettings& Settings : LayerSettings)
+	{
+		Size += Settings.WeightPropertyPath.GetAllocatedSize();
+	}
+
+	Size += LayerStates.GetAllocatedSize();
+	Size += LayerDebugStats.GetAllocatedSize();
+	Size += ActiveLayers.GetAllocatedSize();
+	Size += NamedLayers.GetAllocatedSize();
+	Size += CurveWeightLayers.GetAllocatedSize();
+	Size += LayerSetLayers.GetAllocatedSize();
 
-	for (int32 PoseIndex = 0; PoseIndex < SourcePoses.Num(); ++PoseIndex)
+	Size += LayerSetRemaps.GetAllocatedSize();
+	for (const FMDABoneRemap& Remap : LayerSetRemaps)
 	{
-		switch (SourceBlendModes[PoseIndex])
-		{
-			case EMDABlendMode::Add:
-			{
-				AccumulateAdditivePoseInternal<EMDABlendMode::Add>(OutPose, SourcePoses[PoseIndex], SourceWeights[PoseIndex]);
-				break;
-			}
-			case EMDABlendMode::Subtract:
-			{
-				AccumulateAdditivePoseInternal<EMDABlendMode::Subtract>(OutPose, SourcePoses[PoseIndex], SourceWeights[PoseIndex]);
-				break;
-			}
-			case EMDABlendMode::CoDAdd:
-			{
-				AccumulateAdditivePoseInternal<EMDABlendMode::CoDAdd>(OutPose, SourcePoses[PoseIndex], SourceWeights[PoseIndex]);
-				break;
-			}
-			default:
-			{
-				break;
-			}
-		}
+		Size += Remap.SourceCompactIndices.GetAllocatedSize();
+		Size += Remap.TranslationScales.GetAllocatedSize();
+		Size += Remap.SourceBoneContainer.GetBoneIndicesArray().GetAllocatedSize();
+	}
+
+	Size += ReferencePoses.GetAllocatedSize();
+	for (const TArray<FTransform>& ReferencePose : ReferencePoses)
+	{
+		Size += ReferencePose.GetAllocatedSize();
+	}
+
+	return Size;
+}
+
+FMDAScratchStats FAnimNode_MDA::GetThreadScratchStats()
+{
+	const FMDAData& BlendData = FMDAData::Get();
+
+	FMDAScratchStats Stats;
+	Stats.StackDepth = BlendData.SourcePoses.Num();
+	Stats.StackHighWater = BlendData.StackHighWater;
+	Stats.EvaluateDepth = BlendData.EvaluateDepth;
+	Stats.EvaluateHighWater = BlendData.EvaluateHighWater;
+
+	// the stacks are popped together, any difference in size is a leak
+	const int32 NumSourcePoses = BlendData.SourcePoses.Num();
+	Stats.bStacksBalanced = BlendData.SourceWeights.Num() == NumSourcePoses
+		&& BlendData.SourceBlendModes.Num() == NumSourcePoses
+		&& BlendData.SourceCurves.Num() == NumSourcePoses
+		&& BlendData.SourceAttributes.Num() == NumSourcePoses
+		&& BlendData.SourceLayers.Num() == NumSourcePoses;
+
+	Stats.AllocatedBytes = FMath::Max(BlendData.AllocatedHighWater, BlendData.GetAllocatedSize());
+
+	return Stats;
+}
+
+void FAnimNode_MDA::ForEachNode(UAnimInstance* AnimInstance, TFunctionRef<void(FAnimNode_MDA&)> Func)
+{
+	const IAnimClassInterface* AnimClass = IAnimClassInterface::GetFromClass(AnimInstance->GetClass());
+	if (!AnimClass)
+	{
+		return;
 	}
 
-	// Ensure that all of the resulting rotations are normalized
-	if (SourcePoses.Num() > 0)
+	for (const FStructProperty* NodeProperty : AnimClass->GetAnimNodeProperties())
 	{
-		OutPose.NormalizeRotations();
+		if (NodeProperty->Struct->IsChildOf(FAnimNode_MDA::StaticStruct()))
+		{
+			Func(*NodeProperty->ContainerPtrToValuePtr<FAnimNode_MDA>(AnimInstance));
+		}
 	}
+}
+
+void FAnimNode_MDA::AccumulateAdditivePose(TArrayView<const FCompactPose> SourcePoses, TArrayView<const FBlendedCurve> SourceCurves, TArrayView<const float> SourceWeights, TArrayView<const EMDABlendMode> SourceBlendModes, TArrayView<const FMDALayerSource> SourceLayers, FAnimationPoseData& OutAnimationPoseData)
+{
+	check(SourcePoses.Num() > 0);
+
+	// Get out anim data
+	FCompactPose& OutPose = OutAnimationPoseData.GetPose();
+	FBlendedCurve& OutCurve = OutAnimationPoseData.GetCurve();
+
+	const bool bRecording = FMDACapture::IsCapturing() && FMDACapture::BeginRecord(OutPose, OutCurve, SourcePoses, SourceCurves, SourceWeights, SourceBlendModes, SourceLayers);
 
 	// If curve exists, blend with the weight
 	// TODO: To be optimized
@@ -223,12 +1237,30 @@ void FAnimNode_MDA::AccumulateAdditivePose(TArrayView<const FCompactPose> Source
 		BlendCurves1(FullCurvesArray, FullWeightsArray, OutCurve, CurveBlendOption);
 	}
 
-	if (SourceAttributes.Num() > 0)
+	// Bones last, the views into the scratch stacks may not be read after a parallel accumulation, see AccumulateLayers
+	const FMDABoneContainerRefPose RefPose(OutPose.GetBoneContainer());
+
+	TArray<TArrayView<const FTransform>, TInlineAllocator<8>> LayerTransforms;
+	for (const FCompactPose& SourcePose : SourcePoses)
+	{
+		LayerTransforms.Add(SourcePose.GetBones());
+	}
+
+	// Accumulate and normalize the resulting rotations, in chunks of bones for large poses
+	const bool bParallel = bAllowParallelBoneAccumulation && OutPose.GetNumBones() >= CVarMDAParallelBoneThreshold.GetValueOnAnyThread();
+	MDAParallel::AccumulateLayers(OutPose.GetMutableBones(), LayerTransforms, SourceLayers, SourceWeights, SourceBlendModes, RefPose, bParallel);
+
+	if (bRecording)
 	{
-		UE::Anim::Attributes::BlendAttributes(SourceAttributes, SourceWeights, OutAttributes);
+		FMDACapture::EndRecord(OutPose, OutCurve);
 	}
 }
 
+void FAnimNode_MDA::AccumulateLayerTransforms(TArrayView<FTransform> OutTransforms, TArrayView<const TArrayView<const FTransform>> LayerTransforms, TArrayView<const FMDALayerSource> SourceLayers, TArrayView<const float> SourceWeights, TArrayView<const EMDABlendMode> SourceBlendModes, TArrayView<const FTransform> RefTransforms, bool bParallel)
+{
+	MDAParallel::AccumulateLayers(OutTransforms, LayerTransforms, SourceLayers, SourceWeights, SourceBlendModes, FMDARefTransforms(RefTransforms), bParallel);
+}
+
 void FAnimNode_MDA::BlendCurves1(const TArrayView<const FBlendedCurve> SourceCurves, const TArrayView<const float> SourceWeights, FBlendedCurve& OutCurve, ECurveBlendOption::Type BlendOption)
 {
 	if (SourceCurves.IsEmpty())
@@ -310,3 +1342,167 @@ void FAnimNode_MDA::BlendCurves1(const TArrayView<const FBlendedCurve> SourceCur
 		}
 	}
 }
+
+#if !UE_BUILD_SHIPPING
+static FAutoConsoleCommand MDAMemoryReportCommand(
+	TEXT("MDA.MemoryReport"),
+	TEXT("Logs the memory of MDA node instances"),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		int32 NumNodes = 0;
+		SIZE_T TotalSize = 0;
+		SIZE_T MaxSize = 0;
+
+		for (TObjectIterator<UAnimInstance> It; It; ++It)
+		{
+			if (It->HasAnyFlags(RF_ClassDefaultObject | RF_ArchetypeObject))
+			{
+				continue;
+			}
+
+			FAnimNode_MDA::ForEachNode(*It, [&NumNodes, &TotalSize, &MaxSize](FAnimNode_MDA& Node)
+			{
+				const SIZE_T Size = Node.GetInstanceMemorySize();
+				++NumNodes;
+				TotalSize += Size;
+				MaxSize = FMath::Max(MaxSize, Size);
+			});
+		}
+
+		UE_LOG(LogMDA, Log, TEXT("MDA nodes: %d, total: %llu bytes, average: %llu bytes, max: %llu bytes, layer state: %d bytes"),
+			NumNodes, static_cast<uint64>(TotalSize), static_cast<uint64>(NumNodes > 0 ? TotalSize / NumNodes : 0), static_cast<uint64>(MaxSize), static_cast<int32>(sizeof(FMDALayerState)));
+	}));
+
+static FAutoConsoleCommand MDABenchParallelAccumulateCommand(
+	TEXT("MDA.Bench.ParallelAccumulate"),
+	TEXT("Times serial and parallel bone accumulation over bone counts to find a.MDA.ParallelBoneThreshold. Args: [Layers] [Iterations]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const int32 NumLayers = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 4;
+		const int32 NumIterations = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 200;
+		const int32 BoneCounts[] = { 64, 128, 256, 384, 512, 768, 1024, 1536, 2048 };
+
+		FRandomStream Random(0x4D4441);
+		auto RandomTransform = [&Random](float Scale)
+		{
+			return FTransform(FRotator(Random.FRandRange(-30.f, 30.f), Random.FRandRange(-30.f, 30.f), Random.FRandRange(-30.f, 30.f)) * Scale, Random.GetUnitVector() * Scale);
+		};
+
+		UE_LOG(LogMDA, Log, TEXT("MDA parallel accumulation: %d layers, %d iterations, chunk size %d, %d worker threads"), NumLayers, NumIterations, MDAParallel::GetChunkSize(), FTaskGraphInterface::Get().GetNumWorkerThreads());
+
+		int32 Crossover = INDEX_NONE;
+		for (const int32 NumBones : BoneCounts)
+		{
+			TArray<FTransform> BaseTransforms;
+			TArray<FTransform> RefTransforms;
+			for (int32 BoneIndex = 0; BoneIndex < NumBones; ++BoneIndex)
+			{
+				BaseTransforms.Add(RandomTransform(1.f));
+				RefTransforms.Add(RandomTransform(1.f));
+			}
+
+			TArray<TArray<FTransform>> Additives;
+			TArray<TArrayView<const FTransform>> LayerTransforms;
+			TArray<FMDALayerSource> SourceLayers;
+			TArray<float> SourceWeights;
+			TArray<EMDABlendMode> SourceBlendModes;
+			Additives.SetNum(NumLayers);
+			for (int32 LayerIndex = 0; LayerIndex < NumLayers; ++LayerIndex)
+			{
+				for (int32 BoneIndex = 0; BoneIndex < NumBones; ++BoneIndex)
+				{
+					Additives[LayerIndex].Add(RandomTransform(0.1f));
+				}
+				LayerTransforms.Add(Additives[LayerIndex]);
+				SourceLayers.AddDefaulted();
+				SourceWeights.Add(Random.FRandRange(0.1f, 1.f));
+				SourceBlendModes.Add(static_cast<EMDABlendMode>(LayerIndex % 3));
+			}
+
+			const FMDARefTransforms RefPose(RefTransforms);
+
+			double Seconds[2];
+			for (int32 Parallel = 0; Parallel < 2; ++Parallel)
+			{
+				TArray<FTransform> OutTransforms;
+				const double StartTime = FPlatformTime::Seconds();
+				for (int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+				{
+					OutTransforms = BaseTransforms;
+					MDAParallel::AccumulateLayers(MakeArrayView(OutTransforms), LayerTransforms, SourceLayers, SourceWeights, SourceBlendModes, RefPose, Parallel != 0);
+				}
+				Seconds[Parallel] = FPlatformTime::Seconds() - StartTime;
+			}
+
+			const double SerialUs = Seconds[0] * 1e6 / NumIterations;
+			const double ParallelUs = Seconds[1] * 1e6 / NumIterations;
+			if (Crossover == INDEX_NONE && ParallelUs < SerialUs)
+			{
+				Crossover = NumBones;
+			}
+
+			UE_LOG(LogMDA, Log, TEXT("  %5d bones: serial %8.2f us, parallel %8.2f us, speedup %.2fx"), NumBones, SerialUs, ParallelUs, SerialUs / FMath::Max(ParallelUs, UE_DOUBLE_SMALL_NUMBER));
+		}
+
+		if (Crossover != INDEX_NONE)
+		{
+			UE_LOG(LogMDA, Log, TEXT("Parallel accumulation is faster from %d bones, a.MDA.ParallelBoneThreshold is %d"), Crossover, CVarMDAParallelBoneThreshold.GetValueOnGameThread());
+		}
+		else
+		{
+			UE_LOG(LogMDA, Log, TEXT("Parallel accumulation was not faster at any bone count"));
+		}
+	}));
+
+static FAutoConsoleCommand MDAFullPoseCheckCommand(
+	TEXT("MDA.FullPose.Check"),
+	TEXT("Accumulates random full poses as Full Pose Minus Reference layers onto their own reference poses, and checks that the full poses come back. Args: [Bones]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const int32 NumBones = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 10000;
+
+		// reference rotations far from identity, where the order of the delta shows
+		FRandomStream Random(NumBones);
+		auto RandomTransform = [&Random]()
+		{
+			return FTransform(FQuat(Random.GetUnitVector(), Random.FRandRange(-UE_PI, UE_PI)), Random.GetUnitVector() * Random.FRandRange(0.f, 100.f));
+		};
+
+		TArray<FTransform> FullTransforms;
+		TArray<FTransform> RefTransforms;
+		for (int32 BoneIndex = 0; BoneIndex < NumBones; ++BoneIndex)
+		{
+			FullTransforms.Add(RandomTransform());
+			RefTransforms.Add(RandomTransform());
+		}
+
+		FMDALayerSource LayerSource;
+		LayerSource.ReferencePose = RefTransforms;
+		const FMDARefTransforms RefPose(RefTransforms);
+
+		bool bPassed = true;
+		for (const EMDABlendMode BlendMode : { EMDABlendMode::Add, EMDABlendMode::CoDAdd })
+		{
+			TArray<FTransform> Transforms = RefTransforms;
+			VisitAdditiveSource(FullTransforms, LayerSource, [&Transforms, &RefPose, BlendMode](const auto& AdditiveSource)
+			{
+				AccumulateAdditivePoseInternal(MakeArrayView(Transforms), AdditiveSource, RefPose, 1.f, BlendMode);
+			});
+
+			float MaxTranslationError = 0.f;
+			float MaxRotationError = 0.f;
+			for (int32 BoneIndex = 0; BoneIndex < NumBones; ++BoneIndex)
+			{
+				MaxTranslationError = FMath::Max(MaxTranslationError, static_cast<float>(FVector::Dist(Transforms[BoneIndex].GetTranslation(), FullTransforms[BoneIndex].GetTranslation())));
+				MaxRotationError = FMath::Max(MaxRotationError, static_cast<float>(Transforms[BoneIndex].GetRotation().GetNormalized().AngularDistance(FullTransforms[BoneIndex].GetRotation())));
+			}
+
+			const bool bModePassed = MaxTranslationError <= 1e-3f && MaxRotationError <= 1e-4f;
+			bPassed &= bModePassed;
+			UE_LOG(LogMDA, Log, TEXT("  %s: max translation error %.6f, max rotation error %.6f rad (%s)"),
+				BlendMode == EMDABlendMode::Add ? TEXT("Add") : TEXT("CoD Add"), MaxTranslationError, MaxRotationError, bModePassed ? TEXT("ok") : TEXT("FAILED"));
+		}
+
+		UE_LOG(LogMDA, Log, TEXT("MDA full pose check %s, %d bones"), bPassed ? TEXT("passed") : TEXT("FAILED"), NumBones);
+	}));
+#endif
@@ -0,0 +1,211 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#include "MDABudgetSubsystem.h"
+#include "Animation/AnimInstance.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+
+#ifdef UE_INLINE_GENERATED_CPP_BY_NAME
+#include UE_INLINE_GENERATED_CPP_BY_NAME(MDABudgetSubsystem)
+#endif
+
+static TAutoConsoleVariable<bool> CVarMDABudgetEnable(
+	TEXT("a.MDA.Budget.Enable"),
+	false,
+	TEXT("Limits MDA layer work to a per-frame budget. Applies to nodes initialized afterwards"));
+
+static TAutoConsoleVariable<float> CVarMDABudgetFrameBudgetMs(
+	TEXT("a.MDA.Budget.FrameBudgetMs"),
+	1.f,
+	TEXT("Budget of MDA evaluation across all anim instances of a world, in milliseconds per frame"));
+
+static TAutoConsoleVariable<int32> CVarMDABudgetLowPriority(
+	TEXT("a.MDA.Budget.LowPriority"),
+	128,
+	TEXT("Layers with a priority below are dropped first"));
+
+static TAutoConsoleVariable<int32> CVarMDABudgetStepsPerFrame(
+	TEXT("a.MDA.Budget.StepsPerFrame"),
+	4,
+	TEXT("Number of anim instances whose budget level changes at once. Levels then stay until the averaged cost has taken the change in"));
+
+namespace MDABudget
+{
+	// Levels an anim instance goes through from the least to the most restricted
+	// 1: drop low priority layers, 2: drop all layers but the ones of priority 255
+	constexpr int32 MaxLevel = 2;
+
+	// The cost of an instance is averaged over about this many frames
+	constexpr int32 AveragingFrames = 10;
+
+	void ApplyLevel(FMDABudgetState& State, int32 LowPriority)
+	{
+		const uint8 Priority = static_cast<uint8>(FMath::Clamp(LowPriority, 0, 255));
+		switch (State.Level)
+		{
+			case 0: State.DropBelowPriority = 0; break;
+			case 1: State.DropBelowPriority = Priority; break;
+			default: State.DropBelowPriority = MAX_uint8; break;
+		}
+	}
+}
+
+bool UMDABudgetSubsystem::IsBudgetEnabled()
+{
+	return CVarMDABudgetEnable.GetValueOnAnyThread();
+}
+
+TSharedPtr<FMDABudgetState, ESPMode::ThreadSafe> UMDABudgetSubsystem::Register(const UAnimInstance* AnimInstance)
+{
+	FScopeLock Lock(&StatesLock);
+
+	for (const TSharedPtr<FMDABudgetState, ESPMode::ThreadSafe>& State : States)
+	{
+		if (State->AnimInstance == AnimInstance)
+		{
+			return State;
+		}
+	}
+
+	TSharedPtr<FMDABudgetState, ESPMode::ThreadSafe> State = MakeShared<FMDABudgetState, ESPMode::ThreadSafe>();
+	State->AnimInstance = AnimInstance;
+	States.Add(State);
+	return State;
+}
+
+void UMDABudgetSubsystem::SetSignificance(const UAnimInstance* AnimInstance, float Significance)
+{
+	FScopeLock Lock(&StatesLock);
+
+	for (const TSharedPtr<FMDABudgetState, ESPMode::ThreadSafe>& State : States)
+	{
+		if (State->AnimInstance == AnimInstance)
+		{
+			State->SignificanceOverride = Significance;
+		}
+	}
+}
+
+bool UMDABudgetSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+TStatId UMDABudgetSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMDABudgetSubsystem, STATGROUP_Tickables);
+}
+
+void UMDABudgetSubsystem::Tick(float DeltaTime)
+{
+	FScopeLock Lock(&StatesLock);
+
+	// Drop the states of nodes that are gone
+	States.RemoveAll([](const TSharedPtr<FMDABudgetState, ESPMode::ThreadSafe>& State)
+	{
+		return State.IsUnique() || !State->AnimInstance.IsValid();
+	});
+
+	TArray<FVector, TInlineAllocator<4>> ViewLocations;
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (PlayerController && PlayerController->PlayerCameraManager)
+		{
+			ViewLocations.Add(PlayerController->PlayerCameraManager->GetCameraLocation());
+		}
+	}
+
+	// Gather the measured cost and significance
+	LastFrameCostMs = 0.f;
+	for (const TSharedPtr<FMDABudgetState, ESPMode::ThreadSafe>& State : States)
+	{
+		const float CostMs = static_cast<float>(FPlatformTime::ToMilliseconds64(State->Cycles.exchange(0, std::memory_order_relaxed)));
+		State->AverageMs = FMath::Lerp(State->AverageMs, CostMs, 1.f / MDABudget::AveragingFrames);
+		LastFrameCostMs += CostMs;
+
+		if (State->SignificanceOverride >= 0.f)
+		{
+			State->Significance = State->SignificanceOverride;
+		}
+		else
+		{
+			const USkeletalMeshComponent* Component = State->AnimInstance->GetSkelMeshComponent();
+			if (Component && ViewLocations.Num() > 0)
+			{
+				double MinDistanceSquared = UE_BIG_NUMBER;
+				for (const FVector& ViewLocation : ViewLocations)
+				{
+					MinDistanceSquared = FMath::Min(MinDistanceSquared, FVector::DistSquared(ViewLocation, Component->GetComponentLocation()));
+				}
+
+				// Distance in meters
+				State->Significance = static_cast<float>(1.0 / (1.0 + FMath::Sqrt(MinDistanceSquared) * 0.01));
+			}
+			else
+			{
+				State->Significance = 1.f;
+			}
+		}
+	}
+
+	// Least significant first
+	States.Sort([](const TSharedPtr<FMDABudgetState, ESPMode::ThreadSafe>& A, const TSharedPtr<FMDABudgetState, ESPMode::ThreadSafe>& B)
+	{
+		return A->Significance < B->Significance;
+	});
+
+	const float BudgetMs = CVarMDABudgetFrameBudgetMs.GetValueOnGameThread();
+	const int32 LowPriority = CVarMDABudgetLowPriority.GetValueOnGameThread();
+	const int32 StepsPerFrame = FMath::Max(CVarMDABudgetStepsPerFrame.GetValueOnGameThread(), 1);
+
+	// Restrict or restore a few instances, then wait for the averaged cost to show the effect before the next change. Changing
+	// every frame would go on restricting while the average still lags behind, and overshoot both ways
+	if (CooldownFrames > 0)
+	{
+		--CooldownFrames;
+		return;
+	}
+
+	float AverageCostMs = 0.f;
+	for (const TSharedPtr<FMDABudgetState, ESPMode::ThreadSafe>& State : States)
+	{
+		AverageCostMs += State->AverageMs;
+	}
+
+	int32 Steps = 0;
+	if (AverageCostMs > BudgetMs)
+	{
+		for (int32 Index = 0; Index < States.Num() && Steps < StepsPerFrame; ++Index)
+		{
+			FMDABudgetState& State = *States[Index];
+			if (State.Level < MDABudget::MaxLevel)
+			{
+				++State.Level;
+				MDABudget::ApplyLevel(State, LowPriority);
+				++Steps;
+			}
+		}
+	}
+	else if (AverageCostMs < BudgetMs * 0.8f)
+	{
+		for (int32 Index = States.Num() - 1; Index >= 0 && Steps < StepsPerFrame; --Index)
+		{
+			FMDABudgetState& State = *States[Index];
+			if (State.Level > 0)
+			{
+				--State.Level;
+				MDABudget::ApplyLevel(State, LowPriority);
+				++Steps;
+			}
+		}
+	}
+
+	if (Steps > 0)
+	{
+		CooldownFrames = MDABudget::AveragingFrames;
+	}
+}
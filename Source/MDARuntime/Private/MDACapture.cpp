@@ -0,0 +1,532 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#include "MDACapture.h"
+#include "MDARuntime.h"
+#include "Async/Async.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include <atomic>
+
+namespace MDACapture
+{
+	constexpr uint32 FileMagic = 0x4341444D; // "MDAC"
+	constexpr uint32 FileVersion = 3;
+
+	struct FThreadBuffer
+	{
+		TArray<uint8> Data;
+		uint32 Session = 0;
+	};
+
+	std::atomic<bool> bCapturing(false);
+	std::atomic<uint32> Session(0);
+
+	// Threads between BeginRecord and EndRecord, which Stop waits for before taking the buffers
+	std::atomic<int32> NumRecorders(0);
+
+	// Game thread only
+	int32 FramesRemaining = 0;
+	uint32 StartFrame = 0;
+	FString CaptureFileName;
+	FDelegateHandle EndFrameHandle;
+
+	// Only locked when a thread records its first accumulation of a session
+	FCriticalSection BuffersLock;
+	TArray<TSharedPtr<FThreadBuffer, ESPMode::ThreadSafe>> Buffers;
+
+	FThreadBuffer& GetThreadBuffer()
+	{
+		static thread_local TSharedPtr<FThreadBuffer, ESPMode::ThreadSafe> ThreadBuffer;
+
+		const uint32 CurrentSession = Session.load(std::memory_order_acquire);
+		if (!ThreadBuffer.IsValid() || ThreadBuffer->Session != CurrentSession)
+		{
+			ThreadBuffer = MakeShared<FThreadBuffer, ESPMode::ThreadSafe>();
+			ThreadBuffer->Session = CurrentSession;
+
+			FScopeLock Lock(&BuffersLock);
+			Buffers.Add(ThreadBuffer);
+		}
+
+		return *ThreadBuffer;
+	}
+
+	// Transforms are written in single precision
+	constexpr int64 TransformSize = sizeof(FQuat4f) + 2 * sizeof(FVector3f);
+	constexpr int64 CurveValueSize = sizeof(uint16) + sizeof(float);
+
+	// Counts read from a file are only trusted when the data they describe fits in what is left of it. Otherwise the
+	// archive is set to error, so that a corrupt or truncated file ends the replay instead of allocating or seeking wildly
+	bool CheckRemaining(FArchive& Ar, int64 NumElements, int64 ElementSize)
+	{
+		if (Ar.IsError() || NumElements < 0 || NumElements * ElementSize > Ar.TotalSize() - Ar.Tell())
+		{
+			Ar.SetError();
+			return false;
+		}
+		return true;
+	}
+
+	void WriteTransform(FArchive& Ar, const FTransform& Transform)
+	{
+		FQuat4f Rotation(Transform.GetRotation());
+		FVector3f Translation(Transform.GetTranslation());
+		FVector3f Scale(Transform.GetScale3D());
+		Ar << Rotation << Translation << Scale;
+	}
+
+	void ReadTransform(FArchive& Ar, FTransform& OutTransform)
+	{
+		FQuat4f Rotation;
+		FVector3f Translation;
+		FVector3f Scale;
+		Ar << Rotation << Translation << Scale;
+		OutTransform.SetComponents(FQuat(Rotation), FVector(Translation), FVector(Scale));
+	}
+
+	void WriteTransforms(FArchive& Ar, TArrayView<const FTransform> Transforms)
+	{
+		for (const FTransform& Transform : Transforms)
+		{
+			WriteTransform(Ar, Transform);
+		}
+	}
+
+	void ReadTransforms(FArchive& Ar, int32 NumBones, TArray<FTransform>& OutTransforms)
+	{
+		if (!CheckRemaining(Ar, NumBones, TransformSize))
+		{
+			return;
+		}
+
+		OutTransforms.SetNumUninitialized(NumBones);
+		for (FTransform& Transform : OutTransforms)
+		{
+			ReadTransform(Ar, Transform);
+		}
+	}
+
+	// Additives are written in the compact bones of the output, with a flag for bones they don't apply to
+	template <typename SourceType>
+	void WriteAdditive(FArchive& Ar, int32 NumBones, const SourceType& AdditiveSource)
+	{
+		for (int32 BoneIndex = 0; BoneIndex < NumBones; ++BoneIndex)
+		{
+			FTransform Transform = FTransform::Identity;
+			uint8 bValid = AdditiveSource.GetTransform(BoneIndex, Transform) ? 1 : 0;
+			Ar << bValid;
+			WriteTransform(Ar, Transform);
+		}
+	}
+
+	void ReadAdditive(FArchive& Ar, int32 NumBones, TArray<FTransform>& OutTransforms, TArray<bool>& OutValid)
+	{
+		if (!CheckRemaining(Ar, NumBones, sizeof(uint8) + TransformSize))
+		{
+			return;
+		}
+
+		OutTransforms.SetNumUninitialized(NumBones);
+		OutValid.SetNumUninitialized(NumBones);
+		for (int32 BoneIndex = 0; BoneIndex < NumBones; ++BoneIndex)
+		{
+			uint8 bValid = 0;
+			Ar << bValid;
+			OutValid[BoneIndex] = bValid != 0;
+
+			ReadTransform(Ar, OutTransforms[BoneIndex]);
+		}
+	}
+
+	// Curves are written as pairs of UID and value
+	void WriteCurve(FArchive& Ar, const FBlendedCurve& Curve)
+	{
+		TArray<TPair<uint16, float>, TInlineAllocator<32>> Values;
+
+		if (const TArray<uint16>* LUT = Curve.GetUIDToArrayLookupTable())
+		{
+			for (int32 UID = 0; UID < LUT->Num(); ++UID)
+			{
+				if (Curve.IsEnabled(static_cast<SmartName::UID_Type>(UID)))
+				{
+					Values.Emplace(static_cast<uint16>(UID), Curve.Get(static_cast<SmartName::UID_Type>(UID)));
+				}
+			}
+		}
+
+		int32 NumValues = Values.Num();
+		Ar << NumValues;
+		for (TPair<uint16, float>& Value : Values)
+		{
+			Ar << Value.Key << Value.Value;
+		}
+	}
+
+	void SkipCurve(FArchive& Ar)
+	{
+		int32 NumValues = 0;
+		Ar << NumValues;
+		if (CheckRemaining(Ar, NumValues, CurveValueSize))
+		{
+			Ar.Seek(Ar.Tell() + NumValues * CurveValueSize);
+		}
+	}
+
+	void OnEndFrame()
+	{
+		if (--FramesRemaining <= 0)
+		{
+			FMDACapture::Stop();
+		}
+	}
+}
+
+bool FMDACapture::IsCapturing()
+{
+	return MDACapture::bCapturing.load(std::memory_order_relaxed);
+}
+
+void FMDACapture::Start(int32 NumFrames, const FString& FileName)
+{
+	check(IsInGameThread());
+	using namespace MDACapture;
+
+	if (IsCapturing())
+	{
+		Stop();
+	}
+
+	FramesRemaining = FMath::Max(NumFrames, 1);
+	StartFrame = static_cast<uint32>(GFrameCounter);
+	CaptureFileName = FileName.IsEmpty()
+		? FPaths::ProfilingDir() / TEXT("MDA") / FString::Printf(TEXT("MDA_%s.mdacap"), *FDateTime::Now().ToString())
+		: FileName;
+
+	{
+		FScopeLock Lock(&BuffersLock);
+		Buffers.Reset();
+	}
+
+	Session.fetch_add(1, std::memory_order_release);
+	bCapturing.store(true, std::memory_order_release);
+	EndFrameHandle = FCoreDelegates::OnEndFrame.AddStatic(&MDACapture::OnEndFrame);
+
+	UE_LOG(LogMDA, Log, TEXT("Capturing %d frames to %s"), FramesRemaining, *CaptureFileName);
+}
+
+void FMDACapture::Stop()
+{
+	check(IsInGameThread());
+	using namespace MDACapture;
+
+	if (!IsCapturing())
+	{
+		return;
+	}
+
+	// Stop can be called in the middle of a frame, so wait for the threads still recording. A thread counts itself before
+	// checking the flag, so either it is waited for or it sees the flag cleared and doesn't record
+	bCapturing.store(false);
+	FCoreDelegates::OnEndFrame.Remove(EndFrameHandle);
+	while (NumRecorders.load() > 0)
+	{
+		FPlatformProcess::YieldThread();
+	}
+
+	TArray<TSharedPtr<FThreadBuffer, ESPMode::ThreadSafe>> CapturedBuffers;
+	{
+		FScopeLock Lock(&BuffersLock);
+		CapturedBuffers = MoveTemp(Buffers);
+	}
+
+	// write the file in the background
+	Async(EAsyncExecution::ThreadPool, [CapturedBuffers = MoveTemp(CapturedBuffers), FileName = CaptureFileName]()
+	{
+		TArray<uint8> FileData;
+		FMemoryWriter Writer(FileData);
+
+		uint32 Magic = FileMagic;
+		uint32 Version = FileVersion;
+		Writer << Magic << Version;
+
+		for (const TSharedPtr<FThreadBuffer, ESPMode::ThreadSafe>& Buffer : CapturedBuffers)
+		{
+			Writer.Serialize(const_cast<uint8*>(Buffer->Data.GetData()), Buffer->Data.Num());
+		}
+
+		if (FFileHelper::SaveArrayToFile(FileData, *FileName))
+		{
+			UE_LOG(LogMDA, Log, TEXT("Capture saved to %s (%d bytes)"), *FileName, FileData.Num());
+		}
+		else
+		{
+			UE_LOG(LogMDA, Error, TEXT("Failed to save capture to %s"), *FileName);
+		}
+	});
+}
+
+bool FMDACapture::BeginRecord(const FCompactPose& OutPose, const FBlendedCurve& OutCurve, TArrayView<const FCompactPose> SourcePoses, TArrayView<const FBlendedCurve> SourceCurves, TArrayView<const float> SourceWeights, TArrayView<const EMDABlendMode> SourceBlendModes, TArrayView<const FMDALayerSource> SourceLayers)
+{
+	using namespace MDACapture;
+
+	NumRecorders.fetch_add(1);
+	if (!bCapturing.load())
+	{
+		NumRecorders.fetch_sub(1);
+		return false;
+	}
+
+	FThreadBuffer& Buffer = GetThreadBuffer();
+	FMemoryWriter Writer(Buffer.Data, false, true);
+
+	uint32 Frame = static_cast<uint32>(GFrameCounter) - StartFrame;
+	int32 NumBones = OutPose.GetNumBones();
+	int32 NumLayers = SourcePoses.Num();
+	Writer << Frame << NumBones << NumLayers;
+
+	// reference locations for CoD Add
+	const FBoneContainer& BoneContainer = OutPose.GetBoneContainer();
+	for (const FCompactPoseBoneIndex BoneIndex : OutPose.ForEachBoneIndex())
+	{
+		FVector3f RefLocation(BoneContainer.GetRefPoseTransform(BoneIndex).GetLocation());
+		Writer << RefLocation;
+	}
+
+	WriteTransforms(Writer, OutPose.GetBones());
+	WriteCurve(Writer, OutCurve);
+
+	for (int32 PoseIndex = 0; PoseIndex < NumLayers; ++PoseIndex)
+	{
+		float Weight = SourceWeights[PoseIndex];
+		uint8 BlendMode = static_cast<uint8>(SourceBlendModes[PoseIndex]);
+		Writer << Weight << BlendMode;
+
+		// write the additive as the kernels read it, and whether CoD Add takes its translations as they are
+		VisitAdditiveSource(SourcePoses[PoseIndex].GetBones(), SourceLayers[PoseIndex], [&Writer, NumBones](const auto& AdditiveSource)
+		{
+			uint8 bReferenceDelta = TMDATranslationIsReferenceDelta<std::decay_t<decltype(AdditiveSource)>>::Value ? 1 : 0;
+			Writer << bReferenceDelta;
+			WriteAdditive(Writer, NumBones, AdditiveSource);
+		});
+		WriteCurve(Writer, SourceCurves[PoseIndex]);
+	}
+
+	return true;
+}
+
+void FMDACapture::EndRecord(const FCompactPose& OutPose, const FBlendedCurve& OutCurve)
+{
+	using namespace MDACapture;
+
+	FThreadBuffer& Buffer = GetThreadBuffer();
+	FMemoryWriter Writer(Buffer.Data, false, true);
+
+	WriteTransforms(Writer, OutPose.GetBones());
+	WriteCurve(Writer, OutCurve);
+
+	NumRecorders.fetch_sub(1, std::memory_order_release);
+}
+
+bool FMDACapture::Replay(const FString& FileName, int32 NumIterations, FMDAReplayResult& OutResult, bool bQuantizeLayers)
+{
+	using namespace MDACapture;
+
+	TArray<uint8> FileData;
+	if (!FFileHelper::LoadFileToArray(FileData, *FileName))
+	{
+		UE_LOG(LogMDA, Error, TEXT("Failed to load capture %s"), *FileName);
+		return false;
+	}
+
+	FMemoryReader Reader(FileData);
+
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	Reader << Magic << Version;
+	if (Magic != FileMagic || Version != FileVersion)
+	{
+		UE_LOG(LogMDA, Error, TEXT("%s is not a MDA capture of version %u"), *FileName, FileVersion);
+		return false;
+	}
+
+	OutResult = FMDAReplayResult();
+	uint32 LastFrame = 0;
+
+	TArray<FTransform> RefTransforms;
+	TArray<FTransform> BaseTransforms;
+	TArray<FTransform> ExpectedTransforms;
+	TArray<FTransform> OutTransforms;
+	TArray<TArray<FTransform>> LayerTransforms;
+	TArray<TArrayView<const FTransform>> LayerViews;
+	TArray<TArray<bool>> LayerValid;
+	TArray<bool> LayerIsReferenceDelta;
+	TArray<FMDABoneRemap> LayerRemaps;
+	TArray<FTransform> IdentityTransforms;
+	TArray<FMDAQuantizedAdditivePose> QuantizedLayers;
+	TArray<FMDALayerSource> LayerSources;
+	TArray<FMDAQuantizationError> QuantizationErrors;
+	TArray<float> Weights;
+	TArray<EMDABlendMode> BlendModes;
+
+	while (!Reader.AtEnd() && !Reader.IsError())
+	{
+		uint32 Frame = 0;
+		int32 NumBones = 0;
+		int32 NumLayers = 0;
+		Reader << Frame << NumBones << NumLayers;
+
+		// each layer has at least its weight, blend mode, source flag and curve count
+		if (!CheckRemaining(Reader, NumBones, sizeof(FVector3f)) || !CheckRemaining(Reader, NumLayers, sizeof(float) + 2 * sizeof(uint8) + sizeof(int32)))
+		{
+			UE_LOG(LogMDA, Error, TEXT("Capture %s is truncated or corrupt"), *FileName);
+			return false;
+		}
+
+		RefTransforms.SetNumUninitialized(NumBones);
+		for (FTransform& RefTransform : RefTransforms)
+		{
+			FVector3f RefLocation;
+			Reader << RefLocation;
+			RefTransform = FTransform(FVector(RefLocation));
+		}
+
+		ReadTransforms(Reader, NumBones, BaseTransforms);
+		SkipCurve(Reader);
+
+		LayerTransforms.SetNum(NumLayers);
+		LayerValid.SetNum(NumLayers);
+		LayerIsReferenceDelta.SetNum(NumLayers);
+		Weights.SetNumUninitialized(NumLayers);
+		BlendModes.SetNumUninitialized(NumLayers);
+		for (int32 LayerIndex = 0; LayerIndex < NumLayers && !Reader.IsError(); ++LayerIndex)
+		{
+			uint8 BlendMode = 0;
+			uint8 bReferenceDelta = 0;
+			Reader << Weights[LayerIndex] << BlendMode << bReferenceDelta;
+			BlendModes[LayerIndex] = static_cast<EMDABlendMode>(BlendMode);
+			LayerIsReferenceDelta[LayerIndex] = bReferenceDelta != 0;
+
+			ReadAdditive(Reader, NumBones, LayerTransforms[LayerIndex], LayerValid[LayerIndex]);
+			SkipCurve(Reader);
+		}
+
+		ReadTransforms(Reader, NumBones, ExpectedTransforms);
+		SkipCurve(Reader);
+
+		if (Reader.IsError())
+		{
+			UE_LOG(LogMDA, Error, TEXT("Capture %s is truncated or corrupt"), *FileName);
+			return false;
+		}
+
+		// the captured additives are replayed by the sources of the node: bones skipped by a remap through an identity remap
+		// with the same holes, full pose layers as deltas from an identity reference, which gives the captured delta back
+		IdentityTransforms.Init(FTransform::Identity, NumBones);
+		LayerRemaps.SetNum(NumLayers);
+		QuantizedLayers.SetNum(NumLayers);
+		LayerSources.Reset();
+		LayerSources.SetNum(NumLayers);
+		LayerViews.Reset();
+		for (int32 LayerIndex = 0; LayerIndex < NumLayers; ++LayerIndex)
+		{
+			LayerViews.Add(LayerTransforms[LayerIndex]);
+
+			FMDALayerSource& LayerSource = LayerSources[LayerIndex];
+			if (LayerIsReferenceDelta[LayerIndex])
+			{
+				LayerSource.ReferencePose = IdentityTransforms;
+			}
+			else if (LayerValid[LayerIndex].Contains(false))
+			{
+				FMDABoneRemap& Remap = LayerRemaps[LayerIndex];
+				Remap.TranslationScales.Reset();
+				Remap.SourceCompactIndices.SetNumUninitialized(NumBones);
+				for (int32 BoneIndex = 0; BoneIndex < NumBones; ++BoneIndex)
+				{
+					Remap.SourceCompactIndices[BoneIndex] = LayerValid[LayerIndex][BoneIndex] ? BoneIndex : INDEX_NONE;
+				}
+				LayerSource.Remap = &Remap;
+			}
+			else if (bQuantizeLayers)
+			{
+				// layers with skipped bones or reference deltas can't be quantized, the format has no way to mark either
+				QuantizedLayers[LayerIndex].Quantize(LayerTransforms[LayerIndex], &QuantizationErrors);
+				LayerSource.Quantized = &QuantizedLayers[LayerIndex];
+
+				const FMDAQuantizationError MaxError = FMDAQuantizedAdditivePose::GetMaxError(QuantizationErrors);
+				OutResult.MaxQuantizationError.Translation = FMath::Max(OutResult.MaxQuantizationError.Translation, MaxError.Translation);
+				OutResult.MaxQuantizationError.RotationDegrees = FMath::Max(OutResult.MaxQuantizationError.RotationDegrees, MaxError.RotationDegrees);
+				++OutResult.NumQuantizedLayers;
+			}
+		}
+
+		const double StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < FMath::Max(NumIterations, 1); ++Iteration)
+		{
+			OutTransforms = BaseTransforms;
+			FAnimNode_MDA::AccumulateLayerTransforms(OutTransforms, LayerViews, LayerSources, Weights, BlendModes, RefTransforms, false);
+		}
+		OutResult.Seconds += FPlatformTime::Seconds() - StartTime;
+
+		for (int32 BoneIndex = 0; BoneIndex < NumBones; ++BoneIndex)
+		{
+			const FTransform& Expected = ExpectedTransforms[BoneIndex];
+			const FTransform& Replayed = OutTransforms[BoneIndex];
+			OutResult.MaxTranslationError = FMath::Max(OutResult.MaxTranslationError, static_cast<float>(FVector::Distance(Expected.GetTranslation(), Replayed.GetTranslation())));
+			OutResult.MaxRotationError = FMath::Max(OutResult.MaxRotationError, static_cast<float>(Expected.GetRotation().AngularDistance(Replayed.GetRotation())));
+		}
+
+		if (OutResult.NumRecords == 0 || Frame != LastFrame)
+		{
+			++OutResult.NumFrames;
+			LastFrame = Frame;
+		}
+		++OutResult.NumRecords;
+	}
+
+	return !Reader.IsError();
+}
+
+static FAutoConsoleCommand MDACaptureStartCommand(
+	TEXT("MDA.Capture.Start"),
+	TEXT("Captures the inputs and outputs of MDA nodes. Usage: MDA.Capture.Start <Frames> [File]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const int32 NumFrames = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 1;
+		FMDACapture::Start(NumFrames, Args.Num() > 1 ? Args[1] : FString());
+	}));
+
+static FAutoConsoleCommand MDACaptureStopCommand(
+	TEXT("MDA.Capture.Stop"),
+	TEXT("Stops capturing MDA nodes and saves the capture"),
+	FConsoleCommandDelegate::CreateStatic(&FMDACapture::Stop));
+
+static FAutoConsoleCommand MDACaptureReplayCommand(
+	TEXT("MDA.Capture.Replay"),
+	TEXT("Replays a MDA capture and compares the results. Usage: MDA.Capture.Replay <File> [Iterations] [Quantize]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		if (Args.Num() < 1)
+		{
+			return;
+		}
+
+		FMDAReplayResult Result;
+		const int32 NumIterations = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 1;
+		const bool bQuantizeLayers = Args.Num() > 2 && Args[2] == TEXT("Quantize");
+		if (FMDACapture::Replay(Args[0], NumIterations, Result, bQuantizeLayers))
+		{
+			UE_LOG(LogMDA, Log, TEXT("Replayed %d records of %d frames: %.3f ms per iteration, max translation error %f, max rotation error %f rad"),
+				Result.NumRecords, Result.NumFrames, Result.Seconds * 1000.0 / FMath::Max(NumIterations, 1), Result.MaxTranslationError, Result.MaxRotationError);
+			if (bQuantizeLayers)
+			{
+				UE_LOG(LogMDA, Log, TEXT("Quantized %d layers: max round trip translation error %f, rotation error %f deg"),
+					Result.NumQuantizedLayers, Result.MaxQuantizationError.Translation, Result.MaxQuantizationError.RotationDegrees);
+			}
+		}
+	}));
@@ -0,0 +1,31 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#include "MDALayerActivationLibrary.h"
+#include "AnimNode_MDA.h"
+#include "Animation/AnimInstance.h"
+
+#ifdef UE_INLINE_GENERATED_CPP_BY_NAME
+#include UE_INLINE_GENERATED_CPP_BY_NAME(MDALayerActivationLibrary)
+#endif
+
+void UMDALayerActivationLibrary::ActivateMDALayer(UAnimInstance* AnimInstance, FName LayerName, float BlendTime)
+{
+	if (AnimInstance)
+	{
+		FAnimNode_MDA::ForEachNode(AnimInstance, [LayerName, BlendTime](FAnimNode_MDA& Node)
+		{
+			Node.EnqueueLayerActivation(LayerName, BlendTime, true);
+		});
+	}
+}
+
+void UMDALayerActivationLibrary::DeactivateMDALayer(UAnimInstance* AnimInstance, FName LayerName, float BlendTime)
+{
+	if (AnimInstance)
+	{
+		FAnimNode_MDA::ForEachNode(AnimInstance, [LayerName, BlendTime](FAnimNode_MDA& Node)
+		{
+			Node.EnqueueLayerActivation(LayerName, BlendTime, false);
+		});
+	}
+}
@@ -0,0 +1,7 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#include "MDALayerSet.h"
+
+#ifdef UE_INLINE_GENERATED_CPP_BY_NAME
+#include UE_INLINE_GENERATED_CPP_BY_NAME(MDALayerSet)
+#endif
@@ -0,0 +1,150 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#include "MDAQuantizedPose.h"
+#include "MDARuntime.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+
+uint64 FMDAQuantizedAdditivePose::QuantizeRotation(const FQuat& Rotation)
+{
+	constexpr uint64 ComponentMask = (1ull << 20) - 1;
+
+	const FQuat Normalized = Rotation.GetNormalized();
+	const double Components[4] = { Normalized.X, Normalized.Y, Normalized.Z, Normalized.W };
+
+	// Drop the largest component, which is recovered from the unit length
+	int32 LargestIndex = 0;
+	for (int32 Index = 1; Index < 4; ++Index)
+	{
+		if (FMath::Abs(Components[Index]) > FMath::Abs(Components[LargestIndex]))
+		{
+			LargestIndex = Index;
+		}
+	}
+
+	// q and -q are the same rotation, keep the dropped component positive
+	const double Sign = Components[LargestIndex] < 0.0 ? -1.0 : 1.0;
+
+	uint64 Packed = static_cast<uint64>(LargestIndex) << 62;
+	int32 Shift = 40;
+	for (int32 Index = 0; Index < 4; ++Index)
+	{
+		if (Index == LargestIndex)
+		{
+			continue;
+		}
+
+		// the others are within [-1/sqrt(2), 1/sqrt(2)]
+		const double Unit = FMath::Clamp((Components[Index] * Sign + UE_DOUBLE_HALF_SQRT_2) / UE_DOUBLE_SQRT_2, 0.0, 1.0);
+		Packed |= static_cast<uint64>(FMath::RoundToInt64(Unit * static_cast<double>(ComponentMask))) << Shift;
+		Shift -= 20;
+	}
+
+	return Packed;
+}
+
+void FMDAQuantizedAdditivePose::Quantize(const FCompactPose& AdditivePose, TArray<FMDAQuantizationError>* OutErrors)
+{
+	Quantize(MakeArrayView(AdditivePose.GetBones().GetData(), AdditivePose.GetNumBones()), OutErrors);
+}
+
+void FMDAQuantizedAdditivePose::Quantize(TArrayView<const FTransform> AdditiveTransforms, TArray<FMDAQuantizationError>* OutErrors)
+{
+	const int32 NumBones = AdditiveTransforms.Num();
+	Bones.SetNumUninitialized(NumBones);
+
+	if (OutErrors)
+	{
+		OutErrors->SetNumUninitialized(NumBones);
+	}
+
+	for (int32 BoneIndex = 0; BoneIndex < NumBones; ++BoneIndex)
+	{
+		const FTransform& Transform = AdditiveTransforms[BoneIndex];
+		const FVector Translation = Transform.GetTranslation();
+
+		FMDAQuantizedBone& Bone = Bones[BoneIndex];
+		Bone.Translation[0] = FFloat16(static_cast<float>(Translation.X));
+		Bone.Translation[1] = FFloat16(static_cast<float>(Translation.Y));
+		Bone.Translation[2] = FFloat16(static_cast<float>(Translation.Z));
+		Bone.Rotation = QuantizeRotation(Transform.GetRotation());
+
+		if (OutErrors)
+		{
+			FTransform Quantized;
+			GetTransform(BoneIndex, Quantized);
+
+			FMDAQuantizationError& Error = (*OutErrors)[BoneIndex];
+			Error.Translation = static_cast<float>(FVector::Distance(Translation, Quantized.GetTranslation()));
+			Error.RotationDegrees = static_cast<float>(FMath::RadiansToDegrees(Transform.GetRotation().GetNormalized().AngularDistance(Quantized.GetRotation())));
+		}
+	}
+}
+
+FMDAQuantizationError FMDAQuantizedAdditivePose::GetMaxError(TArrayView<const FMDAQuantizationError> Errors)
+{
+	FMDAQuantizationError MaxError;
+	for (const FMDAQuantizationError& Error : Errors)
+	{
+		MaxError.Translation = FMath::Max(MaxError.Translation, Error.Translation);
+		MaxError.RotationDegrees = FMath::Max(MaxError.RotationDegrees, Error.RotationDegrees);
+	}
+	return MaxError;
+}
+
+void FMDAQuantizedAdditivePose::LogErrors(const FBoneContainer& BoneContainer, TArrayView<const FMDAQuantizationError> Errors, int32 MaxBones)
+{
+	TArray<int32> SortedBones;
+	SortedBones.Reserve(Errors.Num());
+	for (int32 BoneIndex = 0; BoneIndex < Errors.Num(); ++BoneIndex)
+	{
+		SortedBones.Add(BoneIndex);
+	}
+
+	// Sort by the translation error, then by the rotation error
+	SortedBones.Sort([Errors](int32 A, int32 B)
+	{
+		return Errors[A].Translation != Errors[B].Translation ? Errors[A].Translation > Errors[B].Translation : Errors[A].RotationDegrees > Errors[B].RotationDegrees;
+	});
+
+	const FReferenceSkeleton& RefSkeleton = BoneContainer.GetReferenceSkeleton();
+	for (int32 Index = 0; Index < FMath::Min(MaxBones, SortedBones.Num()); ++Index)
+	{
+		const int32 BoneIndex = SortedBones[Index];
+		const int32 SkeletonBoneIndex = BoneContainer.GetBoneIndicesArray()[BoneIndex];
+		UE_LOG(LogMDA, Log, TEXT("%s: translation error %.5f, rotation error %.5f deg"), *RefSkeleton.GetBoneName(SkeletonBoneIndex).ToString(), Errors[BoneIndex].Translation, Errors[BoneIndex].RotationDegrees);
+	}
+}
+
+#if !UE_BUILD_SHIPPING
+static FAutoConsoleCommand MDAQuantizeCheckCommand(
+	TEXT("MDA.Quantize.Check"),
+	TEXT("Round trips random additive transforms through the quantized format and checks the errors. Args: [Bones] [MaxTranslation]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const int32 NumBones = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 100000;
+		const float MaxTranslation = Args.Num() > 1 ? FMath::Max(FCString::Atof(*Args[1]), 1.f) : 100.f;
+
+		FRandomStream Random(NumBones);
+		TArray<FTransform> Transforms;
+		Transforms.SetNumUninitialized(NumBones);
+		for (FTransform& Transform : Transforms)
+		{
+			const FQuat Rotation(Random.GetUnitVector(), Random.FRandRange(-UE_PI, UE_PI));
+			Transform.SetComponents(Rotation, Random.GetUnitVector() * Random.FRandRange(0.f, MaxTranslation), FVector::OneVector);
+		}
+
+		FMDAQuantizedAdditivePose Pose;
+		TArray<FMDAQuantizationError> Errors;
+		Pose.Quantize(Transforms, &Errors);
+		const FMDAQuantizationError MaxError = FMDAQuantizedAdditivePose::GetMaxError(Errors);
+
+		// half precision keeps 11 significant bits, the rotation components 20 bits over [-1/sqrt(2), 1/sqrt(2)]
+		const float TranslationBound = MaxTranslation * UE_SQRT_3 / 2048.f;
+		const float RotationBound = 0.01f;
+		const bool bPassed = MaxError.Translation <= TranslationBound && MaxError.RotationDegrees <= RotationBound;
+
+		UE_LOG(LogMDA, Log, TEXT("Quantized %d bones to %llu bytes: max translation error %f (bound %f), max rotation error %f deg (bound %f). %s"),
+			NumBones, static_cast<uint64>(Pose.GetAllocatedSize()), MaxError.Translation, TranslationBound, MaxError.RotationDegrees, RotationBound, bPassed ? TEXT("Passed") : TEXT("FAILED"));
+	}));
+#endif
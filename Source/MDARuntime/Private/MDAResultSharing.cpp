@@ -0,0 +1,181 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#include "MDAResultSharing.h"
+#include "MDARuntime.h"
+#include "HAL/IConsoleManager.h"
+#include <atomic>
+
+static TAutoConsoleVariable<bool> CVarMDASharingEnable(
+	TEXT("a.MDA.Sharing.Enable"),
+	true,
+	TEXT("Lets MDA nodes with result sharing enabled reuse the output of a node with the same key in the frame"));
+
+namespace MDAResultSharing
+{
+	// State word of a slot: frame in the high 32 bits, readers in bits 8-31, status in the low 8 bits
+	enum class ESlotStatus : uint64
+	{
+		Empty = 0,
+		Writing = 1,
+		Ready = 2,
+	};
+
+	constexpr uint64 StatusMask = 0xFF;
+	constexpr uint64 ReaderOne = 1ull << 8;
+	constexpr uint64 ReaderMask = 0xFFFFFFull << 8;
+	constexpr int32 NumSlots = 256;
+
+	FORCEINLINE uint32 GetFrame(uint64 State) { return static_cast<uint32>(State >> 32); }
+	FORCEINLINE ESlotStatus GetStatus(uint64 State) { return static_cast<ESlotStatus>(State & StatusMask); }
+	FORCEINLINE uint64 MakeState(uint32 Frame, ESlotStatus Status) { return (static_cast<uint64>(Frame) << 32) | static_cast<uint64>(Status); }
+
+	struct FSlot
+	{
+		std::atomic<uint64> State { 0 };
+
+		// Only written while the slot is claimed for writing, and read while counted as a reader
+		uint64 Key = 0;
+		TArray<FTransform> Bones;
+		FBlendedCurve Curve;
+		UE::Anim::FStackAttributeContainer Attributes;
+		TArray<float> CurveWeights;
+	};
+
+	FSlot Slots[NumSlots];
+
+	std::atomic<uint64> Hits { 0 };
+	std::atomic<uint64> Misses { 0 };
+	std::atomic<uint64> Published { 0 };
+	std::atomic<uint64> Ineligible { 0 };
+
+	// Starts above the frame of empty slots
+	std::atomic<uint32> CurrentFrame { 1 };
+
+	FORCEINLINE uint32 GetCurrentFrame()
+	{
+		return CurrentFrame.load(std::memory_order_relaxed);
+	}
+
+	FORCEINLINE FSlot& GetSlot(uint64 Key)
+	{
+		return Slots[Key % NumSlots];
+	}
+}
+
+bool FMDAResultSharing::IsEnabled()
+{
+	return CVarMDASharingEnable.GetValueOnAnyThread();
+}
+
+void FMDAResultSharing::BeginFrame()
+{
+	MDAResultSharing::CurrentFrame.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64 FMDAResultSharing::CombineKey(uint64 Key, uint64 Value)
+{
+	// splitmix64 finalizer over the running key
+	uint64 Hash = Key ^ (Value + 0x9E3779B97F4A7C15ull + (Key << 6) + (Key >> 2));
+	Hash = (Hash ^ (Hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+	Hash = (Hash ^ (Hash >> 27)) * 0x94D049BB133111EBull;
+	return Hash ^ (Hash >> 31);
+}
+
+uint64 FMDAResultSharing::CombineKeyFloat(uint64 Key, float Value)
+{
+	uint32 Bits;
+	FMemory::Memcpy(&Bits, &Value, sizeof(Bits));
+	return CombineKey(Key, Bits);
+}
+
+bool FMDAResultSharing::TryCopy(uint64 Key, FCompactPose& OutPose, FBlendedCurve& OutCurve, UE::Anim::FStackAttributeContainer& OutAttributes, TArrayView<float> OutCurveWeights)
+{
+	using namespace MDAResultSharing;
+
+	FSlot& Slot = GetSlot(Key);
+	const uint32 Frame = GetCurrentFrame();
+
+	// Count as a reader so the slot isn't claimed while copying
+	uint64 State = Slot.State.load(std::memory_order_acquire);
+	do
+	{
+		if (GetFrame(State) != Frame || GetStatus(State) != ESlotStatus::Ready || (State & ReaderMask) == ReaderMask)
+		{
+			Misses.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+	while (!Slot.State.compare_exchange_weak(State, State + ReaderOne, std::memory_order_acquire, std::memory_order_acquire));
+
+	const bool bHit = Slot.Key == Key && Slot.Bones.Num() == OutPose.GetNumBones() && Slot.CurveWeights.Num() == OutCurveWeights.Num();
+	if (bHit)
+	{
+		FMemory::Memcpy(OutPose.GetMutableBones().GetData(), Slot.Bones.GetData(), Slot.Bones.Num() * sizeof(FTransform));
+		OutCurve.CopyFrom(Slot.Curve);
+		OutAttributes.CopyFrom(Slot.Attributes);
+		FMemory::Memcpy(OutCurveWeights.GetData(), Slot.CurveWeights.GetData(), Slot.CurveWeights.Num() * sizeof(float));
+	}
+
+	Slot.State.fetch_sub(ReaderOne, std::memory_order_release);
+
+	(bHit ? Hits : Misses).fetch_add(1, std::memory_order_relaxed);
+	return bHit;
+}
+
+void FMDAResultSharing::Publish(uint64 Key, const FCompactPose& Pose, const FBlendedCurve& Curve, const UE::Anim::FStackAttributeContainer& Attributes, TArrayView<const float> CurveWeights)
+{
+	using namespace MDAResultSharing;
+
+	FSlot& Slot = GetSlot(Key);
+	const uint32 Frame = GetCurrentFrame();
+
+	// Claim the slot if it holds an older frame and nobody reads it. Another key in this frame keeps it
+	uint64 State = Slot.State.load(std::memory_order_acquire);
+	if ((GetFrame(State) == Frame && GetStatus(State) != ESlotStatus::Empty) || (State & ReaderMask) != 0)
+	{
+		return;
+	}
+
+	if (!Slot.State.compare_exchange_strong(State, MakeState(Frame, ESlotStatus::Writing), std::memory_order_acquire))
+	{
+		return;
+	}
+
+	Slot.Key = Key;
+	Slot.Bones.Reset();
+	Slot.Bones.Append(Pose.GetBones());
+	Slot.Curve.CopyFrom(Curve);
+	Slot.Attributes.CopyFrom(Attributes);
+	Slot.CurveWeights.Reset();
+	Slot.CurveWeights.Append(CurveWeights.GetData(), CurveWeights.Num());
+
+	Slot.State.store(MakeState(Frame, ESlotStatus::Ready), std::memory_order_release);
+	Published.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FMDAResultSharing::AddIneligible()
+{
+	MDAResultSharing::Ineligible.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FMDAResultSharing::LogStats(bool bReset)
+{
+	using namespace MDAResultSharing;
+
+	const uint64 NumHits = bReset ? Hits.exchange(0) : Hits.load();
+	const uint64 NumMisses = bReset ? Misses.exchange(0) : Misses.load();
+	const uint64 NumPublished = bReset ? Published.exchange(0) : Published.load();
+	const uint64 NumIneligible = bReset ? Ineligible.exchange(0) : Ineligible.load();
+	const uint64 NumLookups = NumHits + NumMisses;
+
+	UE_LOG(LogMDA, Log, TEXT("MDA result sharing: %llu hits, %llu misses (%.1f%% hit rate), %llu published, %llu evaluations without a key"),
+		NumHits, NumMisses, NumLookups > 0 ? 100.0 * NumHits / NumLookups : 0.0, NumPublished, NumIneligible);
+}
+
+static FAutoConsoleCommand MDASharingStatsCommand(
+	TEXT("MDA.Sharing.Stats"),
+	TEXT("Logs the hit and miss counters of MDA result sharing. Args: [Reset]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FMDAResultSharing::LogStats(Args.Num() > 0 && Args[0].Equals(TEXT("Reset"), ESearchCase::IgnoreCase));
+	}));
@@ -1,18 +1,24 @@
 // Copyright 2023 dest1yo. All Rights Reserved.
 
 #include "MDARuntime.h"
+#include "MDAResultSharing.h"
+#include "Misc/CoreDelegates.h"
 
 #define LOCTEXT_NAMESPACE "FMDARuntimeModule"
 
+DEFINE_LOG_CATEGORY(LogMDA);
+
 void FMDARuntimeModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
+	BeginFrameHandle = FCoreDelegates::OnBeginFrame.AddStatic(&FMDAResultSharing::BeginFrame);
 }
 
 void FMDARuntimeModule::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
+	FCoreDelegates::OnBeginFrame.Remove(BeginFrameHandle);
 }
 
 #undef LOCTEXT_NAMESPACE
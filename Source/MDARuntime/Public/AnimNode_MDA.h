@@ -4,8 +4,16 @@
 
 #include "Animation/AnimNodeBase.h"
 #include "Animation/InputScaleBias.h"
+#include "Containers/Queue.h"
+#include "MDAQuantizedPose.h"
 #include "AnimNode_MDA.generated.h" 
 
+class UAnimSequenceBase;
+class UMDALayerSet;
+struct FMDABudgetState;
+class USkeleton;
+struct FMDAData;
+
 UENUM()
 enum class EMDABlendMode : uint8
 {
@@ -14,6 +22,206 @@ enum class EMDABlendMode : uint8
 	CoDAdd UMETA(DisplayName="CoD Add"),
 };
 
+UENUM()
+enum class EMDALayerInput : uint8
+{
+	Additive UMETA(DisplayName="Additive"),
+	FullPoseMinusReference UMETA(DisplayName="Full Pose Minus Reference"),
+};
+
+UENUM()
+enum class EMDAReferencePose : uint8
+{
+	SkeletonRefPose UMETA(DisplayName="Skeleton Ref Pose"),
+	SequenceFrame UMETA(DisplayName="Sequence Frame"),
+};
+
+UENUM()
+enum class EMDAWeightSource : uint8
+{
+	Pin UMETA(DisplayName="Pin"),
+	Curve UMETA(DisplayName="Curve"),
+	Property UMETA(DisplayName="Property"),
+};
+
+UENUM()
+enum class EMDAActivationMode : uint8
+{
+	Weights UMETA(DisplayName="Weights"),
+	Events UMETA(DisplayName="Events"),
+};
+
+// Per layer settings that are not exposed as pins
+USTRUCT()
+struct MDARUNTIME_API FMDALayerSettings
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** Where the weight of this layer comes from. Curve and Property are resolved once at initialization and skip the pin */
+	UPROPERTY(EditAnywhere, Category=Weight)
+	EMDAWeightSource WeightSource = EMDAWeightSource::Pin;
+
+	/** Curve of the base pose that drives the weight. The value evaluated last frame is used, since weights are needed before evaluation */
+	UPROPERTY(EditAnywhere, Category=Weight, meta=(EditCondition="WeightSource == EMDAWeightSource::Curve", EditConditionHides))
+	FName WeightCurveName;
+
+	/** Float or double variable of the anim instance that drives the weight. Members of struct variables are separated by '.' */
+	UPROPERTY(EditAnywhere, Category=Weight, meta=(EditCondition="WeightSource == EMDAWeightSource::Property", EditConditionHides))
+	FString WeightPropertyPath;
+
+	/** Whether the pose of this layer is an additive, or a full pose that the reference pose is subtracted from */
+	UPROPERTY(EditAnywhere, Category=Input)
+	EMDALayerInput Input = EMDALayerInput::Additive;
+
+	/** The pose subtracted from a full pose. It's sampled once when the required bones change */
+	UPROPERTY(EditAnywhere, Category=Input, meta=(EditCondition="Input == EMDALayerInput::FullPoseMinusReference", EditConditionHides))
+	EMDAReferencePose ReferencePose = EMDAReferencePose::SkeletonRefPose;
+
+	UPROPERTY(EditAnywhere, Category=Input, meta=(EditCondition="Input == EMDALayerInput::FullPoseMinusReference && ReferencePose == EMDAReferencePose::SequenceFrame", EditConditionHides))
+	TObjectPtr<UAnimSequenceBase> ReferenceSequence;
+
+	UPROPERTY(EditAnywhere, Category=Input, meta=(EditCondition="Input == EMDALayerInput::FullPoseMinusReference && ReferencePose == EMDAReferencePose::SequenceFrame", EditConditionHides, ClampMin="0"))
+	int32 ReferenceFrame = 0;
+
+	/** Layers of lower priority are frozen or dropped first when MDA budget is exceeded */
+	UPROPERTY(EditAnywhere, Category=Budget)
+	uint8 Priority = 128;
+
+	/** Name gameplay code activates this layer by, when the node is in Events activation mode */
+	UPROPERTY(EditAnywhere, Category=Activation)
+	FName LayerName;
+};
+
+// Runtime state of a pose layer. Packed into one record so that per frame loops only touch one array
+struct FMDALayerState
+{
+	float ActualAlpha = 0.f;
+
+	// Index into the curve weight layers or property offset from the anim instance, by the weight source
+	int32 WeightBindingData = INDEX_NONE;
+
+	EMDAWeightSource WeightSource = EMDAWeightSource::Pin;
+
+	// Budget priority
+	uint8 Priority = 128;
+
+	// Index into the reference poses for layers taking full poses, or SkeletonRefPose
+	uint8 ReferencePoseIndex : 7;
+	uint8 bWeightPropertyIsDouble : 1;
+
+	static constexpr uint8 NoReferencePose = 0x7F;
+
+	// The reference pose is read from the required bones, which all instances share
+	static constexpr uint8 SkeletonRefPose = 0x7E;
+
+	FMDALayerState() : ReferencePoseIndex(NoReferencePose), bWeightPropertyIsDouble(false) {}
+};
+
+static_assert(sizeof(FMDALayerState) == 12, "FMDALayerState should stay packed");
+
+// A layer whose weight is bound to a curve of the base pose
+struct FMDACurveWeightLayer
+{
+	int32 PoseIndex = INDEX_NONE;
+	SmartName::UID_Type CurveUID = SmartName::MaxUID;
+
+	// Curve weight evaluated last frame
+	float LastWeight = 0.f;
+};
+
+// Activation or deactivation of a layer, queued from gameplay code
+struct FMDALayerActivationCommand
+{
+	FName LayerName;
+	float BlendTime = 0.f;
+	bool bActivate = false;
+};
+
+// A layer that is active or blending out, in Events activation mode
+struct FMDAActiveLayer
+{
+	int32 PoseIndex = INDEX_NONE;
+	float Alpha = 0.f;
+	float TargetAlpha = 0.f;
+
+	// Alpha per second, 0 to jump to the target
+	float BlendRate = 0.f;
+};
+
+// Per layer debug counters are only read by the Animation Blueprint editor, so game builds never pay for them
+#ifndef MDA_LAYER_DEBUG_STATS
+#define MDA_LAYER_DEBUG_STATS WITH_EDITOR
+#endif
+
+// State of the scratch stacks of a thread
+struct FMDAScratchStats
+{
+	int32 StackDepth = 0;
+	int32 StackHighWater = 0;
+	int32 EvaluateDepth = 0;
+	int32 EvaluateHighWater = 0;
+	bool bStacksBalanced = true;
+	// Largest scratch memory reached, including the bones and curves of pushed poses
+	SIZE_T AllocatedBytes = 0;
+};
+
+// Debug counters of a layer, only updated when MDA_LAYER_DEBUG_STATS is set
+struct FMDALayerDebugStats
+{
+	// Frame the layer input was last evaluated on
+	uint64 LastEvaluatedFrame = 0;
+
+	// Rolling average of the evaluation time of the layer input, in microseconds
+	float AverageMicroseconds = 0.f;
+};
+
+// Maps the compact bones of the anim instance to the bones of a skeleton that additives were authored on
+struct MDARUNTIME_API FMDABoneRemap
+{
+	const USkeleton* SourceSkeleton = nullptr;
+	bool bScaleTranslations = false;
+
+	// Bones of the source skeleton that are mapped, with their parents
+	FBoneContainer SourceBoneContainer;
+
+	// Source compact bone of each target compact bone, INDEX_NONE when not mapped
+	TArray<int32> SourceCompactIndices;
+
+	// Ratio of reference bone lengths of each target compact bone, empty when translations are not scaled
+	TArray<float> TranslationScales;
+
+	/** Builds the tables by bone names */
+	void Build(const USkeleton* InSourceSkeleton, bool bInScaleTranslations, const FBoneContainer& RequiredBones);
+};
+
+// How the kernels read the pose of a layer pushed onto the stacks
+struct FMDALayerSource
+{
+	// The pose is on another skeleton
+	const FMDABoneRemap* Remap = nullptr;
+
+	// The pose is a full pose, to subtract this reference pose from when not empty
+	TArrayView<const FTransform> ReferencePose;
+
+	// The pose is read from this quantized additive instead of the transforms
+	const FMDAQuantizedAdditivePose* Quantized = nullptr;
+};
+
+// Active layer of a layer set
+struct FMDALayerSetLayer
+{
+	const UAnimSequenceBase* Sequence = nullptr;
+	const USkeleton* SourceSkeleton = nullptr;
+	int32 RemapIndex = INDEX_NONE;
+	float Weight = 0.f;
+	float PlayRate = 1.f;
+	float Time = 0.f;
+	EMDABlendMode BlendMode = EMDABlendMode::Add;
+	uint8 Priority = 128;
+	bool bLoop = true;
+	bool bScaleTranslations = false;
+};
+
 // MDA; has dynamic number of blendposes
 USTRUCT(BlueprintInternalUseOnly)
 struct MDARUNTIME_API FAnimNode_MDA : public FAnimNode_Base
@@ -37,18 +245,113 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, EditFixedSize, Category=Config, meta=(BlueprintCompilerGeneratedDefaults))
 	TArray<EMDABlendMode> BlendModes;
 
+	/** Weight bindings and other settings of each layer */
+	UPROPERTY(EditAnywhere, EditFixedSize, Category=Config, meta=(BlueprintCompilerGeneratedDefaults))
+	TArray<FMDALayerSettings> LayerSettings;
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Alpha)
 	FInputScaleBiasClamp AlphaScaleBiasClamp;
 
+	/** Layers sampled from a data asset, applied after the pose layers. Can be swapped at runtime without changing pins */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=LayerSet, meta=(PinHiddenByDefault))
+	TObjectPtr<UMDALayerSet> LayerSet;
+
+	/** Number of layer set layers to preallocate for, so swapping to sets up to this size never allocates */
+	UPROPERTY(EditAnywhere, Category=LayerSet, meta=(ClampMin="0"))
+	int32 MaxLayerSetLayers;
+
 	/** How to blend the curve of layers together */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Config)
 	TEnumAsByte<ECurveBlendOption::Type> CurveBlendOption;
 
+	/** Evaluate a chain of MDA nodes linked by base poses as one node, with one accumulation and one normalization.
+	 * Only applies when the curve blend options match and are not NormalizeByWeight, and no layer weight is bound to a curve */
+	UPROPERTY(EditAnywhere, Category=Config)
+	bool bAllowChainFusion;
+
+	/** Accumulate chunks of bones in parallel when the pose has at least a.MDA.ParallelBoneThreshold bones. For rigs with hundreds of bones */
+	UPROPERTY(EditAnywhere, Category=Performance)
+	bool bAllowParallelBoneAccumulation;
+
+	/** Copy the output of another node evaluated this frame with the same sequences, times, weights and modes, on the same mesh and LOD, instead of evaluating.
+	 * Only applies when the base pose and relevant layers are linked directly to sequence players or to MDA nodes sharing their results. For crowds */
+	UPROPERTY(EditAnywhere, Category=Performance)
+	bool bEnableResultSharing;
+
+	/** Only nodes of the same group share results */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Performance, meta=(PinHiddenByDefault, EditCondition="bEnableResultSharing"))
+	int32 SharingGroup;
+
+	/** Weights: the weight of every layer is read every update.
+	 * Events: layers are off until activated with ActivateMDALayer, and only active or blending layers are updated and evaluated. Their weights are scaled by the activation blend */
+	UPROPERTY(EditAnywhere, Category=Config)
+	EMDAActivationMode ActivationMode;
+
+	/** Set by the compiler when the base pose is linked directly to another MDA node */
+	UPROPERTY()
+	bool bBasePoseIsMDA;
+
+	/** Set by the compiler when the base pose is linked directly to a sequence player */
+	UPROPERTY()
+	bool bBasePoseIsSequencePlayer;
+
+	/** Set by the compiler for each layer linked directly to a sequence player */
+	UPROPERTY()
+	TArray<bool> PoseIsSequencePlayer;
+
+	/** Set by the compiler when a weight pin is linked or bound, so the exposed inputs copy layer weights */
+	UPROPERTY()
+	bool bHasLinkedWeights;
+
+	/** Set by the compiler when another input pin is linked or bound. Without linked inputs the exposed inputs aren't executed */
+	UPROPERTY()
+	bool bHasLinkedInputs;
+
 private:
-	TArray<float> ActualAlphas;
+	// Inline for typical layer counts so that most nodes don't allocate
+	TArray<FMDALayerState, TInlineAllocator<4>> LayerStates;
+
+	// Only the relevant layers of the active layer set
+	TArray<FMDALayerSetLayer> LayerSetLayers;
+
+	// The layer set LayerSetLayers is built from
+	const UMDALayerSet* ActiveLayerSet;
+
+	// Bone remaps of layer set layers authored on other skeletons, shared by layers of the same skeleton
+	TArray<FMDABoneRemap> LayerSetRemaps;
+
+	// MDA node linked to the base pose that this node may fuse with, resolved when linked
+	FAnimNode_MDA* FusedBaseCandidate;
+
+	// Layers whose weights are bound to a curve, in pose order, set at initialization. Few nodes bind curves, so it isn't inline
+	TArray<FMDACurveWeightLayer> CurveWeightLayers;
+
+	// Serial number of the required bones LayerSetRemaps and LayerReferencePoses are built for
+	uint16 CachedBonesSerialNumber;
+
+	// Reference frames of sequences for layers taking full poses, in compact bones
+	TArray<TArray<FTransform>> ReferencePoses;
+
+	// Budget decisions of the anim instance, null when the budget is disabled
+	TSharedPtr<FMDABudgetState, ESPMode::ThreadSafe> BudgetState;
+
+	// Set at initialization when the budget is enabled, the state is then looked up on the game thread in PreUpdate
+	bool bRegisterWithBudget;
+
+	// Per layer, empty when MDA_LAYER_DEBUG_STATS is not set
+	TArray<FMDALayerDebugStats> LayerDebugStats;
+
+	// Active and blending layers in pose order, in Events activation mode
+	TArray<FMDAActiveLayer, TInlineAllocator<4>> ActiveLayers;
+
+	// Pose indices of the named layers, in Events activation mode, so commands don't walk every layer
+	TMultiMap<FName, int32> NamedLayers;
+
+	// Filled from gameplay code on the game thread, drained in update
+	TSharedPtr<TQueue<FMDALayerActivationCommand, EQueueMode::Mpsc>, ESPMode::ThreadSafe> ActivationCommands;
 
 public:
-	FAnimNode_MDA(): CurveBlendOption(ECurveBlendOption::BlendByWeight)
+	FAnimNode_MDA(): MaxLayerSetLayers(8), CurveBlendOption(ECurveBlendOption::BlendByWeight), bAllowChainFusion(true), bAllowParallelBoneAccumulation(false), bEnableResultSharing(false), SharingGroup(0), ActivationMode(EMDAActivationMode::Weights), bBasePoseIsMDA(false), bBasePoseIsSequencePlayer(false), bHasLinkedWeights(true), bHasLinkedInputs(true), ActiveLayerSet(nullptr), FusedBaseCandidate(nullptr), CachedBonesSerialNumber(0), bRegisterWithBudget(false)
 	{
 	}
 
@@ -58,6 +361,8 @@ public:
 	virtual void Update_AnyThread(const FAnimationUpdateContext& Context) override;
 	virtual void Evaluate_AnyThread(FPoseContext& Output) override;
 	virtual void GatherDebugData(FNodeDebugData& DebugData) override;
+	virtual bool HasPreUpdate() const override { return true; }
+	virtual void PreUpdate(const UAnimInstance* InAnimInstance) override;
 	// End of FAnimNode_Base interface
 
 	int32 AddPose()
@@ -65,6 +370,7 @@ public:
 		Poses.AddDefaulted();
 		BlendWeights.Add(1.f);
 		BlendModes.AddDefaulted();
+		LayerSettings.AddDefaulted();
 
 		return Poses.Num();
 	}
@@ -74,86 +380,349 @@ public:
 		Poses.RemoveAt(PoseIndex);
 		BlendWeights.RemoveAt(PoseIndex);
 		BlendModes.RemoveAt(PoseIndex);
+		LayerSettings.RemoveAt(PoseIndex);
+	}
+
+	/** Rebuilds the poses in a new order. NewOrder holds the old index of each new pose, poses left out are removed */
+	void RemapPoses(TArrayView<const int32> NewOrder)
+	{
+		LayerSettings.SetNum(Poses.Num());
+
+		auto Remap = [NewOrder](auto& Array)
+		{
+			auto OldArray = MoveTemp(Array);
+			Array.Reset(NewOrder.Num());
+			for (const int32 OldIndex : NewOrder)
+			{
+				Array.Add(MoveTemp(OldArray[OldIndex]));
+			}
+		};
+
+		Remap(Poses);
+		Remap(BlendWeights);
+		Remap(BlendModes);
+		Remap(LayerSettings);
+	}
+
+	/** Weight of a layer in the last update */
+	float GetLayerActualAlpha(int32 PoseIndex) const
+	{
+		return LayerStates.IsValidIndex(PoseIndex) ? LayerStates[PoseIndex].ActualAlpha : 0.f;
+	}
+
+	/** Debug counters of a layer, null when they are not kept */
+	const FMDALayerDebugStats* GetLayerDebugStats(int32 PoseIndex) const
+	{
+		return LayerDebugStats.IsValidIndex(PoseIndex) ? &LayerDebugStats[PoseIndex] : nullptr;
 	}
 
+	/** Queues the activation or deactivation of the layers of the name, applied in the next update. Only used in Events activation mode */
+	void EnqueueLayerActivation(FName LayerName, float BlendTime, bool bActivate);
+
+	/** Memory of this node instance including its allocations, in bytes */
+	SIZE_T GetInstanceMemorySize() const;
+
+	/** State of the scratch stacks of the calling thread, for tests and tools */
+	static FMDAScratchStats GetThreadScratchStats();
+
+	/** Accumulates the layers on OutTransforms and normalizes the rotations, as AccumulateAdditivePose does for the bones, with the
+	 * reference locations for CoD Add read from RefTransforms. Used to replay captures */
+	static void AccumulateLayerTransforms(TArrayView<FTransform> OutTransforms, TArrayView<const TArrayView<const FTransform>> LayerTransforms, TArrayView<const FMDALayerSource> SourceLayers, TArrayView<const float> SourceWeights, TArrayView<const EMDABlendMode> SourceBlendModes, TArrayView<const FTransform> RefTransforms, bool bParallel);
+
+	/** Calls Func for each MDA node of the anim instance */
+	static void ForEachNode(UAnimInstance* AnimInstance, TFunctionRef<void(FAnimNode_MDA&)> Func);
+
 	void ResetPoses()
 	{
 		Poses.Reset();
 		BlendWeights.Reset();
 		BlendModes.Reset();
+		LayerSettings.Reset();
 	}
 
 private:
+	// Builds the runtime state of layers, resolving the curve and property bindings
+	void InitializeLayerStates(const FAnimationInitializeContext& Context);
+
+	// Rebuilds the active layers when the layer set is changed
+	void UpdateLayerSet(const FAnimationUpdateContext& Context);
+
+	// Builds the bone remaps of layer set layers for the required bones
+	void CacheLayerSetRemaps(const FBoneContainer& RequiredBones);
+
+	// Samples the reference frames of layers taking full poses for the required bones
+	void CacheReferencePoses(const FBoneContainer& RequiredBones);
+
+	// Applies the queued activation commands to the active layers
+	void ApplyActivationCommands();
+
+	// Advances the activation blends, and updates the active layers. Inactive layers are never visited
+	void UpdateActiveLayers(const FAnimationUpdateContext& Context, uint8 DropBelowPriority);
+
+	// Calls Func with the index of each layer that may have a weight, all layers unless in Events activation mode
+	template <typename FuncType>
+	void ForEachLiveLayer(FuncType&& Func) const
+	{
+		if (ActivationMode == EMDAActivationMode::Events)
+		{
+			for (const FMDAActiveLayer& ActiveLayer : ActiveLayers)
+			{
+				Func(ActiveLayer.PoseIndex);
+			}
+		}
+		else
+		{
+			for (int32 PoseIndex = 0; PoseIndex < LayerStates.Num(); ++PoseIndex)
+			{
+				Func(PoseIndex);
+			}
+		}
+	}
+
+	// Builds the key of the inputs of this update, or 0 when they are not all known
+	uint64 BuildSharingKey(const FAnimInstanceProxy* Proxy) const;
+
+	// Adds the last curve weights of this node and of the MDA nodes below its base pose, which a shared result skips
+	void GatherSharedCurveWeights(TArray<float, TInlineAllocator<8>>& OutWeights) const;
+
+	// Does the bookkeeping of an evaluation for a copied result, down the MDA nodes below the base pose. Returns the number of curve weights read
+	int32 ApplySharedResult(TArrayView<const float> CurveWeights);
+
+	// Resolves the MDA node linked to the base pose that this node may fuse with
+	void CacheFusedBaseCandidate();
+
+	// Gets the MDA node linked to the base pose if it can be fused with this node
+	FAnimNode_MDA* GetFusedBaseNode() const;
+
+	// Pushes the layers of this node and the fused nodes below onto the stacks, and evaluates the base pose of the chain.
+	// Attributes are blended into Output level by level, as the nodes would unfused
+	int32 EvaluateChain(FPoseContext& Output, FMDAData& BlendData);
+
+	// Gets the raw weight of a layer from its binding
+	float GetLayerWeight(const FMDALayerState& State, int32 PoseIndex, const UObject* AnimInstanceObject) const;
+
 	void AccumulateAdditivePose(
 	TArrayView<const FCompactPose> SourcePoses,
 	TArrayView<const FBlendedCurve> SourceCurves,
-	TArrayView<const UE::Anim::FStackAttributeContainer> SourceAttributes,
 	TArrayView<const float> SourceWeights,
 	TArrayView<const EMDABlendMode> SourceBlendModes,
+	TArrayView<const FMDALayerSource> SourceLayers,
 	FAnimationPoseData& OutAnimationPoseData
 	);
 
 	static void BlendCurves1(const TArrayView<const FBlendedCurve> SourceCurves, const TArrayView<const float> SourceWeights, FBlendedCurve& OutCurve, ECurveBlendOption::Type BlendOption);
 };
 
-/** Accumulates weighted AdditivePose to BasePose. Rotations are NOT normalized. */
-template <EMDABlendMode>
-static void AccumulateAdditivePoseInternal(FCompactPose& BasePose, const FCompactPose& AdditivePose, float Weight);
+// Reads additive transforms of compact bones from a transform array
+struct FMDATransformSource
+{
+	TArrayView<const FTransform> Transforms;
+
+	explicit FMDATransformSource(TArrayView<const FTransform> InTransforms) : Transforms(InTransforms) {}
 
-template <>
-inline void AccumulateAdditivePoseInternal<EMDABlendMode::Add>(FCompactPose& BasePose, const FCompactPose& AdditivePose, float Weight)
+	FORCEINLINE bool GetTransform(int32 BoneIndex, FTransform& OutTransform) const
+	{
+		OutTransform = Transforms[BoneIndex];
+		return true;
+	}
+};
+
+// Reads additive transforms of target compact bones from a pose of another skeleton, skipping bones that aren't mapped
+struct FMDARemappedSource
 {
-	// Check wight value
-	if (!FAnimWeight::IsRelevant(Weight))
-		return;
+	TArrayView<const FTransform> SourceTransforms;
+	const FMDABoneRemap& Remap;
 
-	for (const FCompactPoseBoneIndex BoneIndex : BasePose.ForEachBoneIndex())
+	FMDARemappedSource(TArrayView<const FTransform> InSourceTransforms, const FMDABoneRemap& InRemap) : SourceTransforms(InSourceTransforms), Remap(InRemap) {}
+
+	FORCEINLINE bool GetTransform(int32 BoneIndex, FTransform& OutTransform) const
 	{
-		FTransform& BaseTransform = BasePose[BoneIndex];
-		FTransform AdditiveTransform = AdditivePose[BoneIndex];
-		AdditiveTransform.BlendWith(FTransform::Identity, 1.f - Weight);
+		const int32 SourceIndex = Remap.SourceCompactIndices[BoneIndex];
+		if (SourceIndex == INDEX_NONE)
+		{
+			return false;
+		}
 
-		BaseTransform.SetLocation(BaseTransform.GetLocation() + AdditiveTransform.GetLocation());
-		BaseTransform.SetRotation(BaseTransform.GetRotation() * AdditiveTransform.GetRotation());
-		BaseTransform.SetScale3D(UE::Math::TVector<double>::One());
+		OutTransform = SourceTransforms[SourceIndex];
+		if (Remap.TranslationScales.Num() > 0)
+		{
+			OutTransform.ScaleTranslation(Remap.TranslationScales[BoneIndex]);
+		}
+		return true;
 	}
-}
+};
 
-template <>
-inline void AccumulateAdditivePoseInternal<EMDABlendMode::Subtract>(FCompactPose& BasePose, const FCompactPose& AdditivePose, float Weight)
+// Reads additive transforms as full pose transforms minus reference pose transforms. Added to a base equal to the reference
+// pose, the delta gives the full pose back
+struct FMDAReferenceDeltaSource
 {
-	// Check wight value
-	if (!FAnimWeight::IsRelevant(Weight))
-		return;
+	TArrayView<const FTransform> Transforms;
+	TArrayView<const FTransform> ReferenceTransforms;
+
+	FMDAReferenceDeltaSource(TArrayView<const FTransform> InTransforms, TArrayView<const FTransform> InReferenceTransforms) : Transforms(InTransforms), ReferenceTransforms(InReferenceTransforms) {}
 
-	for (const FCompactPoseBoneIndex BoneIndex : BasePose.ForEachBoneIndex())
+	FORCEINLINE bool GetTransform(int32 BoneIndex, FTransform& OutTransform) const
 	{
-		FTransform& BaseTransform = BasePose[BoneIndex];
-		FTransform AdditiveTransform = AdditivePose[BoneIndex];
-		AdditiveTransform.BlendWith(FTransform::Identity, 1.f - Weight);
+		// the kernels apply additive rotations on the right of the base, Ref * (Ref^-1 * Full) = Full
+		const FTransform& Transform = Transforms[BoneIndex];
+		const FTransform& ReferenceTransform = ReferenceTransforms[BoneIndex];
+		OutTransform.SetComponents(
+			ReferenceTransform.GetRotation().Inverse() * Transform.GetRotation(),
+			Transform.GetTranslation() - ReferenceTransform.GetTranslation(),
+			FVector::OneVector);
+		return true;
+	}
+};
 
-		BaseTransform.SetLocation(BaseTransform.GetLocation() - AdditiveTransform.GetLocation());
-		BaseTransform.SetRotation(BaseTransform.GetRotation() * AdditiveTransform.GetRotation().Inverse());
-		BaseTransform.SetScale3D(UE::Math::TVector<double>::One());
+/** Calls Func with the additive source that reads the pose of a layer */
+template <typename FuncType>
+FORCEINLINE void VisitAdditiveSource(TArrayView<const FTransform> Transforms, const FMDALayerSource& LayerSource, FuncType&& Func)
+{
+	if (LayerSource.Quantized)
+	{
+		Func(*LayerSource.Quantized);
+	}
+	else if (LayerSource.Remap)
+	{
+		Func(FMDARemappedSource(Transforms, *LayerSource.Remap));
+	}
+	else if (LayerSource.ReferencePose.Num() > 0)
+	{
+		Func(FMDAReferenceDeltaSource(Transforms, LayerSource.ReferencePose));
+	}
+	else
+	{
+		Func(FMDATransformSource(Transforms));
 	}
 }
 
+// Reads reference locations of compact bones from a bone container
+struct FMDABoneContainerRefPose
+{
+	const FBoneContainer& BoneContainer;
+
+	explicit FMDABoneContainerRefPose(const FBoneContainer& InBoneContainer) : BoneContainer(InBoneContainer) {}
+
+	FORCEINLINE FVector GetRefLocation(int32 BoneIndex) const
+	{
+		return BoneContainer.GetRefPoseTransform(FCompactPoseBoneIndex(BoneIndex)).GetLocation();
+	}
+};
+
+// Reads reference locations of compact bones from a transform array
+struct FMDARefTransforms
+{
+	TArrayView<const FTransform> Transforms;
+
+	explicit FMDARefTransforms(TArrayView<const FTransform> InTransforms) : Transforms(InTransforms) {}
+
+	FORCEINLINE FVector GetRefLocation(int32 BoneIndex) const
+	{
+		return Transforms[BoneIndex].GetLocation();
+	}
+};
+
+/** Whether the translations of a source are already relative to the reference pose, so that CoD Add doesn't subtract it again */
+template <typename SourceType>
+struct TMDATranslationIsReferenceDelta
+{
+	static constexpr bool Value = false;
+};
+
 template <>
-inline void AccumulateAdditivePoseInternal<EMDABlendMode::CoDAdd>(FCompactPose& BasePose, const FCompactPose& AdditivePose, float Weight)
+struct TMDATranslationIsReferenceDelta<FMDAReferenceDeltaSource>
+{
+	static constexpr bool Value = true;
+};
+
+/**
+ * Accumulates weighted additive transforms to the bones [BoneBegin, BoneEnd) of BaseTransforms. Rotations are NOT normalized.
+ * SourceType provides GetTransform(BoneIndex, OutTransform), returning false for bones without additive.
+ * RefType provides GetRefLocation(BoneIndex), used by CoD Add.
+ */
+template <EMDABlendMode Mode, typename SourceType, typename RefType>
+void AccumulateAdditivePoseInternal(TArrayView<FTransform> BaseTransforms, const SourceType& AdditiveSource, const RefType& RefPose, float Weight, int32 BoneBegin, int32 BoneEnd)
 {
 	// Check wight value
 	if (!FAnimWeight::IsRelevant(Weight))
 		return;
 
-	for (const FCompactPoseBoneIndex BoneIndex : BasePose.ForEachBoneIndex())
+	for (int32 BoneIndex = BoneBegin; BoneIndex < BoneEnd; ++BoneIndex)
 	{
-		FTransform RefTransform = BasePose.GetRefPose(BoneIndex);
-		FTransform& BaseTransform = BasePose[BoneIndex];
-		FTransform AdditiveTransform = AdditivePose[BoneIndex];
+		FTransform AdditiveTransform;
+		if (!AdditiveSource.GetTransform(BoneIndex, AdditiveTransform))
+		{
+			continue;
+		}
+
+		FTransform& BaseTransform = BaseTransforms[BoneIndex];
 		AdditiveTransform.BlendWith(FTransform::Identity, 1.f - Weight);
 
-		BaseTransform.SetLocation(BaseTransform.GetLocation() + AdditiveTransform.GetLocation() - RefTransform.GetLocation());
-		BaseTransform.SetRotation(BaseTransform.GetRotation() * AdditiveTransform.GetRotation());
+		if constexpr (Mode == EMDABlendMode::Add)
+		{
+			BaseTransform.SetLocation(BaseTransform.GetLocation() + AdditiveTransform.GetLocation());
+			BaseTransform.SetRotation(BaseTransform.GetRotation() * AdditiveTransform.GetRotation());
+		}
+		else if constexpr (Mode == EMDABlendMode::Subtract)
+		{
+			BaseTransform.SetLocation(BaseTransform.GetLocation() - AdditiveTransform.GetLocation());
+			BaseTransform.SetRotation(BaseTransform.GetRotation() * AdditiveTransform.GetRotation().Inverse());
+		}
+		else if constexpr (Mode == EMDABlendMode::CoDAdd)
+		{
+			if constexpr (TMDATranslationIsReferenceDelta<SourceType>::Value)
+			{
+				BaseTransform.SetLocation(BaseTransform.GetLocation() + AdditiveTransform.GetLocation());
+			}
+			else
+			{
+				BaseTransform.SetLocation(BaseTransform.GetLocation() + AdditiveTransform.GetLocation() - RefPose.GetRefLocation(BoneIndex));
+			}
+			BaseTransform.SetRotation(BaseTransform.GetRotation() * AdditiveTransform.GetRotation());
+		}
+
 		BaseTransform.SetScale3D(UE::Math::TVector<double>::One());
 	}
 }
+
+/** Accumulates weighted additive transforms to all bones of BaseTransforms. Rotations are NOT normalized. */
+template <EMDABlendMode Mode, typename SourceType, typename RefType>
+void AccumulateAdditivePoseInternal(TArrayView<FTransform> BaseTransforms, const SourceType& AdditiveSource, const RefType& RefPose, float Weight)
+{
+	AccumulateAdditivePoseInternal<Mode>(BaseTransforms, AdditiveSource, RefPose, Weight, 0, BaseTransforms.Num());
+}
+
+/** Accumulates weighted additive transforms to the bones [BoneBegin, BoneEnd) of BaseTransforms by the blend mode. Rotations are NOT normalized. */
+template <typename SourceType, typename RefType>
+void AccumulateAdditivePoseInternal(TArrayView<FTransform> BaseTransforms, const SourceType& AdditiveSource, const RefType& RefPose, float Weight, EMDABlendMode BlendMode, int32 BoneBegin, int32 BoneEnd)
+{
+	switch (BlendMode)
+	{
+		case EMDABlendMode::Add:
+		{
+			AccumulateAdditivePoseInternal<EMDABlendMode::Add>(BaseTransforms, AdditiveSource, RefPose, Weight, BoneBegin, BoneEnd);
+			break;
+		}
+		case EMDABlendMode::Subtract:
+		{
+			AccumulateAdditivePoseInternal<EMDABlendMode::Subtract>(BaseTransforms, AdditiveSource, RefPose, Weight, BoneBegin, BoneEnd);
+			break;
+		}
+		case EMDABlendMode::CoDAdd:
+		{
+			AccumulateAdditivePoseInternal<EMDABlendMode::CoDAdd>(BaseTransforms, AdditiveSource, RefPose, Weight, BoneBegin, BoneEnd);
+			break;
+		}
+		default:
+		{
+			break;
+		}
+	}
+}
+
+/** Accumulates weighted additive transforms to BaseTransforms by the blend mode. Rotations are NOT normalized. */
+template <typename SourceType, typename RefType>
+void AccumulateAdditivePoseInternal(TArrayView<FTransform> BaseTransforms, const SourceType& AdditiveSource, const RefType& RefPose, float Weight, EMDABlendMode BlendMode)
+{
+	AccumulateAdditivePoseInternal(BaseTransforms, AdditiveSource, RefPose, Weight, BlendMode, 0, BaseTransforms.Num());
+}
@@ -0,0 +1,77 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include <atomic>
+#include "MDABudgetSubsystem.generated.h"
+
+class UAnimInstance;
+
+// Budget decisions and measured cost of an anim instance, shared between MDA nodes and the subsystem
+struct FMDABudgetState
+{
+	// Layers with a priority below are dropped. Written by the subsystem, read by nodes without locks
+	std::atomic<uint8> DropBelowPriority { 0 };
+
+	// Cycles spent evaluating the layers of MDA nodes since the last tick of the subsystem, added by nodes. Base poses are left out
+	std::atomic<uint64> Cycles { 0 };
+
+	// Subsystem only
+	TWeakObjectPtr<const UAnimInstance> AnimInstance;
+	float AverageMs = 0.f;
+	float Significance = 0.f;
+	float SignificanceOverride = -1.f;
+	int32 Level = 0;
+};
+
+/**
+ * Limits the MDA work of all characters in a world to a per-frame budget.
+ * The cost of a node is the evaluation and accumulation of its layers, not of its base pose, which shedding layers can't reduce.
+ * When the measured cost is over budget, layers of low priority on the least significant characters are dropped, then all but the most
+ * important ones, and restored from the most significant characters once there is headroom again. After a change, the next waits until
+ * the averaged cost has taken it in, so the levels don't oscillate.
+ *
+ * Console variables:
+ *	a.MDA.Budget.Enable
+ *	a.MDA.Budget.FrameBudgetMs
+ *	a.MDA.Budget.LowPriority
+ *	a.MDA.Budget.StepsPerFrame
+ */
+UCLASS()
+class MDARUNTIME_API UMDABudgetSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	static bool IsBudgetEnabled();
+
+	/** Gets the shared state of the anim instance, creating it on first use. Called by nodes on the game thread */
+	TSharedPtr<FMDABudgetState, ESPMode::ThreadSafe> Register(const UAnimInstance* AnimInstance);
+
+	/** Sets the significance of an anim instance in [0, 1], e.g. from a significance manager. A negative value uses the distance to the view */
+	UFUNCTION(BlueprintCallable, Category="MDA")
+	void SetSignificance(const UAnimInstance* AnimInstance, float Significance);
+
+	/** MDA evaluation cost of the last frame in milliseconds */
+	float GetLastFrameCostMs() const { return LastFrameCostMs; }
+
+	//~ Begin UWorldSubsystem Interface
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+	//~ End UWorldSubsystem Interface
+
+	//~ Begin FTickableGameObject Interface
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	//~ End FTickableGameObject Interface
+
+private:
+	FCriticalSection StatesLock;
+	TArray<TSharedPtr<FMDABudgetState, ESPMode::ThreadSafe>> States;
+
+	float LastFrameCostMs = 0.f;
+
+	// Frames left before levels can change again
+	int32 CooldownFrames = 0;
+};
@@ -0,0 +1,57 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BonePose.h"
+#include "AnimNode_MDA.h"
+
+// Result of replaying a capture
+struct FMDAReplayResult
+{
+	int32 NumRecords = 0;
+	int32 NumFrames = 0;
+
+	// Largest differences between replayed and captured outputs
+	float MaxTranslationError = 0.f;
+	float MaxRotationError = 0.f;
+
+	// Time of all iterations of the accumulation
+	double Seconds = 0.0;
+
+	// Layers read from quantized additives, and the largest round trip errors of their bones
+	int32 NumQuantizedLayers = 0;
+	FMDAQuantizationError MaxQuantizationError;
+};
+
+/**
+ * Captures the inputs and outputs of MDA accumulation to a binary file for N frames, and replays them headless.
+ * Each thread records into its own buffer, which is only gathered at the end of the last frame, so recording never locks.
+ *
+ * Console commands:
+ *	MDA.Capture.Start <Frames> [File]
+ *	MDA.Capture.Stop
+ *	MDA.Capture.Replay <File> [Iterations] [Quantize]
+ */
+class MDARUNTIME_API FMDACapture
+{
+public:
+	static bool IsCapturing();
+
+	/** Starts capturing on the game thread. The file defaults to Saved/Profiling/MDA */
+	static void Start(int32 NumFrames, const FString& FileName = FString());
+
+	/** Stops capturing and writes the file in the background */
+	static void Stop();
+
+	/** Records the inputs of an accumulation. OutPose is the base pose at this point.
+	 * Returns false when capturing has stopped meanwhile, EndRecord must then not be called */
+	static bool BeginRecord(const FCompactPose& OutPose, const FBlendedCurve& OutCurve, TArrayView<const FCompactPose> SourcePoses, TArrayView<const FBlendedCurve> SourceCurves, TArrayView<const float> SourceWeights, TArrayView<const EMDABlendMode> SourceBlendModes, TArrayView<const FMDALayerSource> SourceLayers);
+
+	/** Records the outputs of the accumulation begun by BeginRecord on this thread */
+	static void EndRecord(const FCompactPose& OutPose, const FBlendedCurve& OutCurve);
+
+	/** Runs the captured frames through the bone accumulation of the node and compares the results with the captured outputs.
+	 * With bQuantizeLayers, layers with every bone mapped are quantized first and read by the kernels in the quantized format */
+	static bool Replay(const FString& FileName, int32 NumIterations, FMDAReplayResult& OutResult, bool bQuantizeLayers = false);
+};
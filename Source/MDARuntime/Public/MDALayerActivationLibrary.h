@@ -0,0 +1,28 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "MDALayerActivationLibrary.generated.h"
+
+class UAnimInstance;
+
+/**
+ * Triggers layers of MDA nodes in Events activation mode from gameplay code.
+ * Commands are queued and applied in the next animation update, to the layers of the name on every MDA node of the anim instance
+ */
+UCLASS()
+class MDARUNTIME_API UMDALayerActivationLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	/** Blends in the layers of the name over the blend time */
+	UFUNCTION(BlueprintCallable, Category="MDA", meta=(DefaultToSelf="AnimInstance"))
+	static void ActivateMDALayer(UAnimInstance* AnimInstance, FName LayerName, float BlendTime = 0.2f);
+
+	/** Blends out the layers of the name over the blend time. They are no longer updated or evaluated once blended out */
+	UFUNCTION(BlueprintCallable, Category="MDA", meta=(DefaultToSelf="AnimInstance"))
+	static void DeactivateMDALayer(UAnimInstance* AnimInstance, FName LayerName, float BlendTime = 0.2f);
+};
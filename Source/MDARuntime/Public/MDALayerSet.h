@@ -0,0 +1,63 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "AnimNode_MDA.h"
+#include "MDALayerSet.generated.h"
+
+class UAnimSequenceBase;
+class USkeleton;
+
+// A layer sampled directly by MDA node
+USTRUCT()
+struct MDARUNTIME_API FMDALayerSetEntry
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** The additive animation of this layer */
+	UPROPERTY(EditAnywhere, Category=Layer)
+	TObjectPtr<UAnimSequenceBase> Sequence;
+
+	/** The blend mode of this layer */
+	UPROPERTY(EditAnywhere, Category=Layer)
+	EMDABlendMode BlendMode = EMDABlendMode::Add;
+
+	/** The weight of this layer. Layers with an irrelevant weight are dropped when the set is activated */
+	UPROPERTY(EditAnywhere, Category=Layer, meta=(ClampMin="0.0", ClampMax="1.0"))
+	float Weight = 1.f;
+
+	UPROPERTY(EditAnywhere, Category=Layer)
+	float PlayRate = 1.f;
+
+	UPROPERTY(EditAnywhere, Category=Layer)
+	bool bLoop = true;
+
+	/** Layers of lower priority are dropped first when MDA budget is exceeded */
+	UPROPERTY(EditAnywhere, Category=Layer)
+	uint8 Priority = 128;
+
+	/** The skeleton the sequence was authored on, defaults to the skeleton of the sequence.
+	 * When it differs from the skeleton of the anim instance, bones are mapped by name and bones that don't map are skipped */
+	UPROPERTY(EditAnywhere, Category=Retarget)
+	TObjectPtr<USkeleton> SourceSkeleton;
+
+	/** Scale translations of mapped bones by the ratio of their reference lengths */
+	UPROPERTY(EditAnywhere, Category=Retarget)
+	bool bScaleTranslations = false;
+};
+
+/**
+ * A set of layers that MDA node can switch to at runtime without changing its pins
+ */
+UCLASS(BlueprintType)
+class MDARUNTIME_API UMDALayerSet : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	/** Layers applied in order after the pose layers of the node */
+	UPROPERTY(EditAnywhere, Category=Layers)
+	TArray<FMDALayerSetEntry> Layers;
+};
@@ -0,0 +1,86 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BonePose.h"
+#include "Math/Float16.h"
+
+// Quantization error of a bone
+struct FMDAQuantizationError
+{
+	// Distance between the source and quantized translation
+	float Translation = 0.f;
+
+	// Angle between the source and quantized rotation in degrees
+	float RotationDegrees = 0.f;
+};
+
+// A bone of quantized additive pose; 16 bytes instead of a full FTransform
+struct FMDAQuantizedBone
+{
+	// Half precision translation
+	FFloat16 Translation[3];
+
+	// Smallest three rotation: the index of the dropped component in the top 2 bits, then 3 x 20 bits of the others
+	uint64 Rotation = 0;
+};
+
+/**
+ * Compact additive pose, meant for caching and sharing layer results.
+ * Scale is not stored since MDA blend modes don't use the scale of additives.
+ * Can be read by AccumulateAdditivePoseInternal directly, dequantizing each bone in registers.
+ * No runtime cache stores poses in this format yet, only capture replay reads it to measure its errors and cost.
+ */
+struct MDARUNTIME_API FMDAQuantizedAdditivePose
+{
+	// Compact bones
+	TArray<FMDAQuantizedBone> Bones;
+
+	/** Quantizes the additive pose, optionally reporting the error of each compact bone */
+	void Quantize(const FCompactPose& AdditivePose, TArray<FMDAQuantizationError>* OutErrors = nullptr);
+	void Quantize(TArrayView<const FTransform> AdditiveTransforms, TArray<FMDAQuantizationError>* OutErrors = nullptr);
+
+	/** Largest errors of the bones */
+	static FMDAQuantizationError GetMaxError(TArrayView<const FMDAQuantizationError> Errors);
+
+	/** Logs the bones with the largest errors */
+	static void LogErrors(const FBoneContainer& BoneContainer, TArrayView<const FMDAQuantizationError> Errors, int32 MaxBones = 10);
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return Bones.GetAllocatedSize();
+	}
+
+	FORCEINLINE bool GetTransform(int32 BoneIndex, FTransform& OutTransform) const
+	{
+		const FMDAQuantizedBone& Bone = Bones[BoneIndex];
+		OutTransform.SetComponents(
+			DequantizeRotation(Bone.Rotation),
+			FVector(Bone.Translation[0].GetFloat(), Bone.Translation[1].GetFloat(), Bone.Translation[2].GetFloat()),
+			FVector::OneVector);
+		return true;
+	}
+
+	static uint64 QuantizeRotation(const FQuat& Rotation);
+
+	static FORCEINLINE FQuat DequantizeRotation(uint64 Packed)
+	{
+		constexpr uint64 ComponentMask = (1ull << 20) - 1;
+		constexpr double Scale = UE_DOUBLE_SQRT_2 / static_cast<double>(ComponentMask);
+
+		const int32 LargestIndex = static_cast<int32>(Packed >> 62);
+		const double A = static_cast<double>((Packed >> 40) & ComponentMask) * Scale - UE_DOUBLE_HALF_SQRT_2;
+		const double B = static_cast<double>((Packed >> 20) & ComponentMask) * Scale - UE_DOUBLE_HALF_SQRT_2;
+		const double C = static_cast<double>(Packed & ComponentMask) * Scale - UE_DOUBLE_HALF_SQRT_2;
+		const double Largest = FMath::Sqrt(FMath::Max(0.0, 1.0 - A * A - B * B - C * C));
+
+		switch (LargestIndex)
+		{
+			case 0: return FQuat(Largest, A, B, C);
+			case 1: return FQuat(A, Largest, B, C);
+			case 2: return FQuat(A, B, Largest, C);
+			default: return FQuat(A, B, C, Largest);
+		}
+	}
+};
@@ -0,0 +1,44 @@
+// Copyright 2023 dest1yo. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BonePose.h"
+#include "Animation/AnimCurveTypes.h"
+#include "Animation/AttributesRuntime.h"
+
+/**
+ * Per-frame table of MDA outputs, so that nodes with the same sharing key in a frame evaluate once.
+ * The first node to publish a key in a frame leads, later nodes with the key copy its output.
+ * Slots are claimed and read through one atomic state word each, so nodes never lock.
+ * Frames are counted by BeginFrame, which the module calls at the start of every engine frame.
+ *
+ * Console variables and commands:
+ *	a.MDA.Sharing.Enable
+ *	MDA.Sharing.Stats [Reset]
+ */
+class MDARUNTIME_API FMDAResultSharing
+{
+public:
+	static bool IsEnabled();
+
+	/** Starts a sharing frame, outputs published before are no longer copied. Tests that simulate frames call it per simulated frame */
+	static void BeginFrame();
+
+	/** Mixes a value into a sharing key */
+	static uint64 CombineKey(uint64 Key, uint64 Value);
+
+	/** Mixes the bits of a float into a sharing key */
+	static uint64 CombineKeyFloat(uint64 Key, float Value);
+
+	/** Copies the output published for the key this frame, and the curve weights the publisher read for its curve bound layers. Returns false on a miss */
+	static bool TryCopy(uint64 Key, FCompactPose& OutPose, FBlendedCurve& OutCurve, UE::Anim::FStackAttributeContainer& OutAttributes, TArrayView<float> OutCurveWeights);
+
+	/** Publishes the output for the key this frame, unless the slot is taken */
+	static void Publish(uint64 Key, const FCompactPose& Pose, const FBlendedCurve& Curve, const UE::Anim::FStackAttributeContainer& Attributes, TArrayView<const float> CurveWeights);
+
+	/** Counts a node that could not build a key this frame */
+	static void AddIneligible();
+
+	static void LogStats(bool bReset);
+};
@@ -6,10 +6,16 @@
 #include "Modules/ModuleInterface.h"
 #include "Modules/ModuleManager.h"
 
+MDARUNTIME_API DECLARE_LOG_CATEGORY_EXTERN(LogMDA, Log, All);
+
 class FMDARuntimeModule : public IModuleInterface
 {
 public:
 	/** IModuleInterface implementation */
 	virtual void StartupModule() override;
 	virtual void ShutdownModule() override;
+
+private:
+	// Starts the result sharing frames
+	FDelegateHandle BeginFrameHandle;
 };